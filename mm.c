@@ -7,35 +7,101 @@
  *
  * I implemented my malloc using an explicit list structure, which used
  * the system of adding predecessor and successor nodes to the free list.
- * The allocated blocks had only an identical header and footer, while the 
- * free blocks contained two 4byte offsets (which could be used thanks to 
- * the fact that the heap was only 2^32 bytes) which pointed to the free 
- * blocks that were before and after it in the list.
+ * Allocated blocks carry only a header: the footer they used to have
+ * is gone, and the previous block's allocation status lives in a spare
+ * low bit of the header instead, so coalesce never needs to read an
+ * allocated footer. Free blocks keep the footer for PREV_BLKP and
+ * contain two offsets which pointed to the free blocks that were
+ * before and after it in the list. The offsets are 4 bytes by default
+ * (which could be used thanks to the fact that the heap was only 2^32
+ * bytes); building with MM_LARGEHEAP widens them to 8 bytes and
+ * fences each heap extension so the heap can grow past 4 GB.
  *
- * The explicit list used a LIFO structure which meant that every new
- * free block got added to the beginning of the free list. 
+ * The free blocks are now kept on segregated lists: an array of list
+ * heads bucketed by power-of-two size class. By default each class is
+ * kept sorted ascending by size, which makes the search below a true
+ * best fit; mm_set_list_policy can switch a class back to the cheaper
+ * LIFO push where every new free block goes to the front.
  *
- * When the free blocks got coalesced I simply switched around the 
- * next and prev pointers to remove the nodes that got coalesced from 
- * the free list.
+ * When free blocks get coalesced they are first unlinked from their
+ * class lists, merged, and the merged block is reinserted into the
+ * class matching its new size.
  *
- * In find fit I used a mixture of first fit and best fit. I would loop 
- * through the free list to find a node of appropriate size. After that 
- * I would check the next few nodes to see if there were any after it
- * that were more suitable.
+ * In find fit I index straight into the class that could hold the
+ * request and do a first fit scan there, falling through to the larger
+ * classes only if that class has nothing big enough.
  *
- * For ease of calculation I used heap_listp as the front and back of my free list.
+ * For ease of calculation I used heap_listp as the front and back of every free list.
  *
+ * calloc tracks the untouched middle of the most recent heap
+ * extension (fresh mem_sbrk memory arrives zeroed) and skips the
+ * memset for payload still inside it, so large zeroed allocations
+ * cost one pass over the data instead of two.
  */
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* NUMA placement goes through raw syscalls so no libnuma dependency
+ * is pulled in; the policy constants are defined locally where
+ * numaif.h is not around. Every call degrades to a silent no-op on
+ * kernels without NUMA support. */
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_F_NODE
+#define MPOL_F_NODE    (1 << 0)
+#endif
+#ifndef MPOL_F_ADDR
+#define MPOL_F_ADDR    (1 << 2)
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE   (1 << 1)
+#endif
+#endif /* def __linux__ */
+
+/* Widest vector ISA the build targets; selected at compile time like
+ * the rdtsc probe in prof_cycles. SSE2 is baseline on x86-64, AVX2
+ * needs -mavx2 */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "mm.h"
+#include "mm_ext.h"
 #include "memlib.h"
 
+#ifdef MM_ARENAS
+#include <pthread.h>
+#endif
+
+/* Building with MM_TRACE (and linking mmtrace.c) records every
+ * public-entry-point call for later replay by mmbench. The depth
+ * counter keeps internal calls - a realloc's fallback malloc, say -
+ * out of the trace so replay sees exactly one op per user call. */
+#ifdef MM_TRACE
+#include "mmtrace.h"
+static __thread int trace_depth;
+#define TRACE_EVENT(op, sz, old, res) \
+    do { if (trace_depth == 0) mm_trace_event(op, sz, old, res); } while (0)
+#define TRACE_SUSPEND() (trace_depth++)
+#define TRACE_RESUME()  (trace_depth--)
+#else
+#define TRACE_EVENT(op, sz, old, res)
+#define TRACE_SUSPEND()
+#define TRACE_RESUME()
+#endif
+
 /* If you want debugging output, use the following macro.  When you hand
  * in, remove the #define DEBUG line. */
 #define DEBUG
@@ -68,18 +134,58 @@
  * Initialize: return -1 on error, 0 on success.
  */
 /*
- *  * If NEXT_FIT defined use next fit search, else use first fit search 
- *   */
+ *  * If NEXT_FIT defined use next fit search, else use first fit search.
+ *   * The mode is also selectable at run time: defining NEXT_FIT only
+ *    * changes the default list policy to MM_LIST_NEXTFIT
+ *     */
 #define NEXT_FITx
 
+#ifdef NEXT_FIT
+#define MM_LIST_DEFAULT MM_LIST_NEXTFIT
+#else
+#define MM_LIST_DEFAULT MM_LIST_SIZE
+#endif
+
 /* $begin mallocmacros */
 /* Basic constants and macros */
 #define WSIZE       4       /* Word and header/footer size (bytes) */ //line:vm:mm:beginconst
 #define DSIZE       8       /* Doubleword size (bytes) */
-#define CHUNKSIZE  (1<<9)  /* Extend heap by this amount (bytes) */  //line:vm:mm:endconst 
+#define CHUNKSIZE  (1<<9)   /* Smallest heap extension (bytes) */  //line:vm:mm:endconst
+#define CHUNKMAX   (1<<22)  /* Default ceiling for the adaptive extension size */
+#define MM_MMAP_THRESHOLD (1<<17) /* Default direct-map cutoff (bytes) */
+
+/* Free-list links are offsets from heap_listp. The compact encoding
+ * is 4 bytes, which caps the heap at 2^32 bytes; MM_LARGEHEAP widens
+ * the links to 8 bytes so the heap can grow past 4 GB, at the cost of
+ * a larger minimum block. The 4-byte header size field is unchanged:
+ * large-heap builds fence each extension so no single block can ever
+ * outgrow it. */
+#ifdef MM_LARGEHEAP
+typedef unsigned long int mm_off_t;
+#define MINBLKSIZE  (3*DSIZE)
+#else
+typedef unsigned int mm_off_t;
 #define MINBLKSIZE  (2*DSIZE)
-
-#define MAX(x, y) ((x) > (y)? (x) : (y))  
+#endif
+#define LINKSIZE ((int)sizeof(mm_off_t))
+
+/* Number of segregated size classes. Class k holds free blocks of
+ * size [64<<(k-1), 64<<k), except class 0 which holds everything
+ * under 64 bytes and the last class which holds everything above. */
+#define SEG_NCLASSES 12
+
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+
+/* Software prefetch for the free-list pointer chases: each hop is a
+ * dependent load into a cold heap page, so touching the next
+ * candidate's header while the current one is examined overlaps the
+ * miss with the compare. No-op where the builtin is unavailable. */
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch((p))
+#else
+#define PREFETCH(p)
+#endif
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) //line:vm:mm:pack
@@ -92,15 +198,44 @@
 #define GET_SIZE(p)  (GET(p) & ~0x7)                   //line:vm:mm:getsize
 #define GET_ALLOC(p) (GET(p) & 0x1)                    //line:vm:mm:getalloc
 
+/* The size is 8-aligned, so bit 1 of the header carries the previous
+ * block's allocation status. Allocated blocks have no footer; only
+ * free blocks keep one for PREV_BLKP, so coalesce learns about the
+ * previous block from this bit instead of reading its footer. */
+#define GET_PREV_ALLOC(p)   (GET(p) & 0x2)
+#define SET_PREV_ALLOC(p)   (PUT(p, GET(p) | 0x2))
+#define CLR_PREV_ALLOC(p)   (PUT(p, GET(p) & ~0x2))
+
+/* Bit 2 marks a directly-mapped large block. Those live outside the
+ * sbrk heap entirely: the word before the payload is a fake header
+ * carrying only this bit, so free and realloc can recognize them
+ * without a table lookup. */
+#define GET_MAPPED(p)       (GET(p) & 0x4)
+
+/* MM_HARDEN: the same spare bit doubles as a canary on allocated
+ * heap-block headers, so free can reject a pointer malloc never
+ * returned with one AND. A mapped block is then recognized by the
+ * bit together with the zero size only the fake map-prefix header
+ * carries. ALLOCBITS is what allocated block headers are PACKed
+ * with; boundary structures (prologue, epilogue, fences) keep the
+ * plain allocated bit since they are never freed. */
+#ifdef MM_HARDEN
+#define ALLOCBITS    0x5
+#define IS_MAPPED(p) (GET_MAPPED(p) && GET_SIZE(p) == 0)
+#else
+#define ALLOCBITS    0x1
+#define IS_MAPPED(p) GET_MAPPED(p)
+#endif
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)                      //line:vm:mm:hdrp
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE) //line:vm:mm:ftrp
 
 /* Given lock ptr bp, compute and/or set pred and succ */
-#define GET_PRED(bp)    (COMP_ADDRESS(*((unsigned int *)(bp))))
-#define GET_SUCC(bp)    (COMP_ADDRESS(*((unsigned int *)(bp + WSIZE))))
-#define SET_PRED(bp, val)   (*(unsigned int *)bp = (unsigned int)COMP_OFFSET(val))
-#define SET_SUCC(bp, val)   (*(unsigned int *)(bp + WSIZE) = (unsigned int)COMP_OFFSET(val)) 
+#define GET_PRED(bp)    (COMP_ADDRESS(*((mm_off_t *)(bp))))
+#define GET_SUCC(bp)    (COMP_ADDRESS(*(mm_off_t *)((char *)(bp) + LINKSIZE)))
+#define SET_PRED(bp, val)   (*(mm_off_t *)(bp) = (mm_off_t)COMP_OFFSET(val))
+#define SET_SUCC(bp, val)   (*(mm_off_t *)((char *)(bp) + LINKSIZE) = (mm_off_t)COMP_OFFSET(val))
 
 
 /* Given block ptr bp, compute address of next and previous blocks */
@@ -109,288 +244,3199 @@
 /* $end mallocmacros */
 
 /* Global variables */
-static char *heap_listp = 0;  /* Pointer to first block */  
-static char *first_free;
-#ifdef NEXT_FIT
-static char *rover;           /* Next fit rover */
+static char *heap_listp = 0;  /* Pointer to first block */
+static char *seg_free[SEG_NCLASSES];  /* Segregated free list heads */
+static int list_policy = MM_LIST_DEFAULT; /* How freelist_add inserts blocks */
+static int defer_coalesce;    /* When set, frees queue up instead of merging */
+
+/* Adaptive growth: the extension size starts at chunk_min, doubles
+ * each time allocation pressure forces another extend (up to
+ * chunk_max), and halves when coalescing produces extension-sized
+ * free blocks - a sign the heap has gone quiescent. */
+static struct mm_config mm_cfg = { CHUNKSIZE, CHUNKMAX, MM_LIST_DEFAULT, 0, 0,
+                                   MM_MMAP_THRESHOLD, 0 };
+static size_t chunk_cur = CHUNKSIZE;  /* Next extension size in bytes */
+
+/* Directly-mapped large blocks carry their map length in the first
+ * word of a 16-byte prefix; the last word of the prefix is the fake
+ * header with the mapped bit. Freeing is one munmap - these blocks
+ * never touch the free lists, so multi-megabyte churn cannot splinter
+ * them into the small-object heap. */
+struct map_prefix {
+    size_t len;           /* Full mapping length, including prefix */
+    unsigned int pad;
+    unsigned int hdr;     /* PACK(0, 1) | 0x4, read via HDRP */
+};
+static size_t st_mapped;      /* Bytes currently mmapped */
+static unsigned long st_nmmap;
+
+/* Persistent heap mode: mm_attach backs the heap with a shared file
+ * mapping instead of mem_sbrk, so a process can reopen its old heap
+ * and find every block where it left it. The free-list links are
+ * base-relative offsets already, which makes the image position
+ * independent; only the list heads and counters need to be spilled
+ * into the header page at detach and rebuilt at attach. The header
+ * roots are written only by a clean mm_detach, so an image without
+ * the clean flag cannot be trusted and is refused. */
+#define MM_PERSIST_MAGIC   "MMPH"
+#define MM_PERSIST_VERSION 1
+#define MM_PERSIST_PAGE    4096              /* Header page in the file */
+#ifndef MM_PERSIST_RESERVE
+#define MM_PERSIST_RESERVE ((size_t)1 << 30) /* Address space reserved */
+#endif
+
+struct persist_hdr {
+    char magic[4];           /* MM_PERSIST_MAGIC */
+    unsigned short version;  /* MM_PERSIST_VERSION */
+    unsigned short flags;    /* MM_SNAPF_* build options of the writer */
+    unsigned int clean;      /* Nonzero: image was detached cleanly */
+    int list_policy;         /* Insertion order the lists were built with */
+    int defer_coalesce;
+    size_t heap_bytes;       /* Heap bytes past the header page */
+    size_t chunk_cur;
+    mm_off_t seg_free[SEG_NCLASSES]; /* Class heads as offsets, 0 = NIL */
+    mm_off_t quarantine_head;
+    int quarantine_count;
+    size_t st_live, st_free_bytes, st_free_blocks, st_overhead;
+    mm_off_t root;           /* Application root block, 0 = unset */
+};
+
+static char *persist_base;    /* Mapping base; NULL = sbrk heap */
+static size_t persist_brk;    /* Heap bytes in use past the header page */
+static int persist_fd = -1;
+
+/* Deferred-coalescing quarantine: a stack threaded through the first
+ * payload word, like the tcache bins. Quarantined blocks stay marked
+ * allocated so no other path tries to merge with them; draining
+ * flips and coalesces them in one batch. Arena builds reuse the
+ * per-arena remote stacks for this instead. */
+#ifndef MM_ARENAS
+#ifndef MM_QUARANTINE_MAX
+#define MM_QUARANTINE_MAX 256
+#endif
+static mm_off_t quarantine_head;  /* Offset of first queued block, 0 = empty */
+static int quarantine_count;
+#endif
+/* Next fit: per-class rovers marking where the last search stopped,
+ * so steady-state churn does not rescan the same unusable stretch at
+ * the list head on every call. freelist_remove keeps them valid when
+ * their block leaves a list - handed out, split by place, or merged
+ * by coalesce - under every policy, so a runtime switch to
+ * MM_LIST_NEXTFIT never sees a dangling rover. */
+static char *seg_rover[SEG_NCLASSES];
+
+/* Known-zero span: the part of the most recent fresh extension that
+ * nothing has written to yet. mem_sbrk memory arrives zeroed from the
+ * OS, so calloc can skip the memset for payload that still lies
+ * inside the span. malloc shrinks the span as blocks (and the link
+ * words of any split remainder) are carved out of it, and records the
+ * returned block's zero part in fresh_ret_* for calloc to read.
+ * Arena builds leave this off: a span can go stale through another
+ * thread's arena without this thread noticing. */
+#ifndef MM_ARENAS
+static char *fresh_lo, *fresh_hi;         /* Guaranteed-zero bytes */
+static char *fresh_ret_lo, *fresh_ret_hi; /* Zero part of last malloc */
+#endif
+
+/* Sampling profiler. Every prof_rate-th malloc/free is timed and
+ * written into a preallocated ring; the hot-path cost when sampling
+ * is off is one test of prof_rate. The aggregate counters (st_*) are
+ * always maintained - they are single adds against memory the slow
+ * path already owns. Under MM_ARENAS they are updated without
+ * synchronization and are therefore approximate, which is fine for
+ * monitoring. */
+#define MM_PROF_RING 256
+static struct mm_sample prof_ring[MM_PROF_RING];
+static unsigned int prof_rate;        /* 0 = sampling off */
+static unsigned int prof_left;        /* Decrementing sample counter */
+static unsigned int prof_head;        /* Next ring slot to write */
+static unsigned int prof_count;       /* Valid entries, <= MM_PROF_RING */
+static unsigned long st_nmalloc, st_nfree, st_nextend, st_nsample;
+static size_t st_live, st_peak_live, st_free_bytes, st_free_blocks;
+static size_t st_peak_heap;
+static size_t st_overhead;    /* Prologue/epilogue/fence bytes, so that
+                               * live + free + overhead == heap size */
+
+#ifdef MM_ARENAS
+/* Multi-arena mode: the heap grows in regions, each owned by one
+ * arena with its own class lists and lock. Regions are fenced with an
+ * allocated header/footer pair so coalesce never crosses an arena
+ * boundary. A block freed from a foreign thread is pushed onto its
+ * home arena's remote stack with a compare-and-swap and drained by
+ * the owner on its next malloc, so no global lock is taken.
+ *
+ * Adding MM_NUMA binds each arena to the NUMA node of the first
+ * thread that claims it: later threads prefer an arena on their own
+ * node, and every region the arena grows is mbind'ed there. Since a
+ * thread only ever searches its own arena's lists, local memory is
+ * preferred by construction - there is no remote fallback to order. */
+#ifndef MM_NARENAS
+#define MM_NARENAS 8
+#endif
+#define MM_MAXREGIONS 4096
+
+struct arena {
+    char *seg_free[SEG_NCLASSES]; /* Per-arena class lists */
+    char *seg_rover[SEG_NCLASSES]; /* Next-fit resume points */
+    pthread_mutex_t lock;         /* Guards the class lists */
+    mm_off_t remote_head;         /* Lock-free stack of foreign frees (offset, 0 = empty) */
+#ifdef MM_NUMA
+    int node;                     /* NUMA node the arena's regions are
+                                   * bound to; -1 until the first
+                                   * thread claims it */
+#endif
+};
+
+struct region {
+    char *lo;                     /* First block payload in region */
+    char *hi;                     /* One past last byte of region */
+    int arena;                    /* Owning arena index */
+};
+
+static struct arena arenas[MM_NARENAS];
+static struct region regions[MM_MAXREGIONS];
+static int nregions;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER; /* Serializes mem_sbrk */
+static unsigned int arena_rr;                 /* Round-robin arena assignment */
+static volatile int heap_ready;               /* Set once mm_init has finished */
+static __thread struct arena *my_arena;       /* This thread's home arena */
+static __thread struct arena *cur_arena;      /* Arena the list helpers operate on */
+
+#define SEG_FREE(c) (cur_arena->seg_free[c])
+#define SEG_ROVER(c) (cur_arena->seg_rover[c])
+#else
+#define SEG_FREE(c) (seg_free[c])
+#define SEG_ROVER(c) (seg_rover[c])
+#endif /* def MM_ARENAS */
+
+#ifdef MM_TCACHE
+/* Thread-local small-object cache: per-thread stacks of fixed-size
+ * blocks that malloc pops and free pushes without touching headers,
+ * footers, or the class lists. Bins cover the adjusted block sizes
+ * from MINBLKSIZE up to TC_MAXSIZE in DSIZE steps; a miss
+ * refills the bin in a batch from the underlying lists and an
+ * overflowing bin flushes half of itself back through the slow path.
+ * Cached blocks stay marked allocated, so the rest of the allocator
+ * never sees them. */
+#ifndef MM_TCACHE_CAP
+#define MM_TCACHE_CAP 32
+#endif
+#ifndef MM_TCACHE_BATCH
+#define MM_TCACHE_BATCH 8
+#endif
+#define TC_MINSIZE MINBLKSIZE
+#define TC_MAXSIZE 72   /* Covers payloads up to 64 bytes */
+#define TC_NBINS   (((TC_MAXSIZE) - (TC_MINSIZE))/DSIZE + 1)
+#define TC_BIN(asize) ((int)(((asize) - (TC_MINSIZE)) / DSIZE))
+
+struct tcache_bin {
+    mm_off_t head;      /* Offset of first cached block, 0 = empty */
+    int count;
+};
+
+static __thread struct tcache_bin tcache[TC_NBINS];
+#endif /* def MM_TCACHE */
+
+#ifdef MM_BITMAP
+/* Bitmap runs: the small-block population is served from dedicated
+ * runs instead of the class lists. A run is one block carved through
+ * the normal find_fit/place path and partitioned into BM_SLOTS
+ * equal slots, each keeping a real allocated header so heap walks,
+ * coalescing neighbors and the prev-alloc protocol see ordinary
+ * blocks. The run's free set is a single bitmap word: malloc is a
+ * find-first-set and a bit clear, free is a bit set - constant time
+ * regardless of how fragmented the rest of the heap is. free routes
+ * a pointer to its run with a binary search over an address-sorted
+ * run table (the lists stay in charge of anything the table cannot
+ * hold). A run whose slots all come back is rewritten as the single
+ * block it was carved from and returned to the class lists. Runs are
+ * process state, not heap state: a persistent image detaches with
+ * its slots as plain allocated blocks, which the next session frees
+ * individually. Under MM_TCACHE the runs take over where the thread
+ * cache stops, so the two fast paths never overlap. */
+#ifdef MM_ARENAS
+#error "MM_BITMAP does not combine with MM_ARENAS"
+#endif
+#ifndef MM_MAXRUNS
+#define MM_MAXRUNS 1024
+#endif
+#define BM_SLOTS   ((int)(8 * sizeof(unsigned long)))
+#define BM_MAXSIZE 256               /* Largest adjusted size served */
+#ifdef MM_TCACHE
+#define BM_MINSIZE (TC_MAXSIZE + DSIZE) /* The tcache owns the sizes below */
+#else
+#define BM_MINSIZE MINBLKSIZE
+#endif
+#define BM_NCLASSES ((int)(((BM_MAXSIZE) - (BM_MINSIZE))/DSIZE) + 1)
+#define BM_CLASS(asize) ((int)(((asize) - (BM_MINSIZE)) / DSIZE))
+
+struct bm_run {
+    char *base;          /* Payload address of slot 0 */
+    unsigned long bits;  /* Bit i set = slot i free */
+    unsigned int asize;  /* Slot size; the last slot also absorbs the
+                          * sub-minimum remainder place() left behind */
+    unsigned int total;  /* Size of the carved parent block */
+    int next, prev;      /* Partial-run list links, -1 = end */
+};
+
+static struct bm_run bm_runs[MM_MAXRUNS];
+static short bm_index[MM_MAXRUNS];  /* Run ids sorted by base address */
+static int bm_nruns;                /* Entries of bm_index in use */
+static int bm_used;                 /* High-water mark of run ids */
+static int bm_free_id;              /* Retired-id list through next, -1 = empty */
+static int bm_partial[BM_NCLASSES]; /* Per-class runs with a free slot */
+#endif /* def MM_BITMAP */
+
+/* Allocation tagging: blocks allocated through mm_malloc_tagged are
+ * remembered in a fixed open-address table keyed by payload address
+ * (same scheme as the trace recorder's id table), and every tag keeps
+ * plain live-bytes/live-blocks counters. Untagged traffic pays
+ * nothing beyond one counter test per free: the table is only probed
+ * while tagged blocks are live. Under MM_ARENAS the table takes a
+ * dedicated lock on the tagged paths; the counters are unsynchronized
+ * estimates like mm_stats. */
+#ifndef MM_TAGTAB
+#define MM_TAGTAB (1 << 12)    /* Table entries; a power of two */
+#endif
+#define TAG_HASH(p) \
+    ((((unsigned long)(p)) >> 4) * 2654435761UL & (MM_TAGTAB - 1))
+#define TAG_DEAD ((void *)-1)  /* Tombstone keeping probe chains alive */
+
+struct tag_ent {
+    void *ptr;          /* Payload address, NULL = empty */
+    size_t size;        /* Capacity charged to the tag at insert */
+    unsigned int tag;
+};
+
+static struct tag_ent tag_tab[MM_TAGTAB];
+static size_t tag_bytes[MM_TAGMAX + 1];  /* Live bytes per tag */
+static size_t tag_blocks[MM_TAGMAX + 1]; /* Live blocks per tag */
+static size_t tag_nlive;    /* Tagged blocks live; 0 skips all probes */
+static size_t tag_dropped;  /* Tags lost to a full table */
+#ifdef MM_ARENAS
+static pthread_mutex_t tag_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
-#define COMP_OFFSET(address)    (unsigned long int)(address) - (unsigned long int)(heap_listp)    
+#define COMP_OFFSET(address)    (unsigned long int)(address) - (unsigned long int)(heap_listp)
 #define COMP_ADDRESS(offset)    (unsigned long int)(heap_listp) + (unsigned long int)(offset)
 
 /* Function prototypes for internal helper routines */
 static void *extend_heap(size_t words);
+static size_t adjust_size(size_t size);
+static void *realloc_impl(void *ptr, size_t size);
 static void place(void *bp, size_t asize);
 static void *find_fit(size_t asize);
 static void *coalesce(void *bp);
 static void printblock(void *bp); 
 static void checkblock(void *bp);
+static void checkblock_fast(void *bp);
 void mm_checkheap(int verbose);
 static int in_freelist(void *bp);
+static int seg_index(size_t size);
 static void freelist_add(void *bp);
+static void freelist_remove(void *bp);
+#ifdef MM_ARENAS
+static struct arena *arena_get(void);
+static struct arena *block_arena(void *bp);
+static void arena_remote_free(struct arena *a, void *bp);
+static void arena_drain(struct arena *a);
+static void lazy_init(void);
+#endif
+static void free_slow(void *bp);
+static void mark_free(void *bp);
+#ifdef MM_HARDEN
+static void harden_check(void *bp);
+#endif
+#ifndef MM_ARENAS
+static void quarantine_drain(void);
+static void fresh_consume(void *bp, size_t asize);
+#endif
+#ifdef MM_BITMAP
+static int bm_lookup(void *bp);
+static void *bm_malloc(size_t asize);
+static int bm_free(void *bp);
+static int bm_run_new(int c);
+static void bm_run_retire(int pos);
+#endif
+static void tag_insert(void *bp, unsigned int tag);
+static unsigned int tag_remove(void *bp);
+static void growth_decay(void *bp);
+static void trim_maybe(void);
+static unsigned long prof_cycles(void);
+static void prof_record(int op, size_t size, unsigned long cycles,
+                        int outcome);
+static void *map_alloc(size_t size);
+static void map_free(void *bp);
+static void *heap_sbrk(int incr);
+static size_t heap_size(void);
+static void *heap_hi(void);
+static void mm_fill0(void *dst, size_t len);
+static void mm_copy(void *dst, const void *src, size_t len);
+#ifdef MM_TCACHE
+static void tcache_fill(struct tcache_bin *bin, size_t asize, int n);
+static void tcache_flush(struct tcache_bin *bin, int n);
+#endif
 
-/* 
- *  * mm_init - Initialize the memory manager 
+/*
+ * heap_sbrk / heap_size / heap_hi - The allocator's view of its
+ * memory source: the memlib sbrk heap normally, or the file mapping
+ * while a persistent heap is attached. In persistent mode growing the
+ * break extends the file with ftruncate; shrinking (mm_trim) cuts the
+ * file back so the image on disk never carries released pages
+ */
+static void *heap_sbrk(int incr)
+{
+    char *old;
+
+    if (persist_base == NULL)
+        return mem_sbrk(incr);
+    old = persist_base + MM_PERSIST_PAGE + persist_brk;
+    if (incr > 0 &&
+        (persist_brk + incr > MM_PERSIST_RESERVE - MM_PERSIST_PAGE ||
+         ftruncate(persist_fd, MM_PERSIST_PAGE + persist_brk + incr) < 0))
+        return (void *)-1;
+    if (incr < 0 && (size_t)-incr > persist_brk)
+        return (void *)-1;   /* Never shrink past the heap base */
+    persist_brk += incr;
+    if (incr < 0 &&
+        ftruncate(persist_fd, MM_PERSIST_PAGE + persist_brk) < 0)
+        { /* The span is gone either way; the file just stays longer */ }
+    return old;
+}
+
+static size_t heap_size(void)
+{
+    return persist_base == NULL ? mem_heapsize() : persist_brk;
+}
+
+static void *heap_hi(void)
+{
+    if (persist_base == NULL)
+        return mem_heap_hi();
+    return persist_base + MM_PERSIST_PAGE + persist_brk - 1;
+}
+
+/*
+ *  * mm_init - Initialize the memory manager
  *   */
-int mm_init(void) 
+int mm_init(void)
 {
-    ;
+    int i;
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1) //line:vm:mm:begininit
+    if ((heap_listp = heap_sbrk(4*WSIZE)) == (void *)-1) //line:vm:mm:begininit
         return -1;
     PUT(heap_listp, 0);                          /* Alignment padding */
-    PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */ 
-    PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
-    PUT(heap_listp + (3*WSIZE), PACK(0, 1));     /* Epilogue header */
-    heap_listp += (2*WSIZE);                     //line:vm:mm:endinit  
-    first_free = heap_listp;
-
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
+    PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); /* Prologue header */
+    PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
+    PUT(heap_listp + (3*WSIZE), PACK(0, 1) | 0x2); /* Epilogue header, prologue before it */
+    heap_listp += (2*WSIZE);                     //line:vm:mm:endinit
+    for (i = 0; i < SEG_NCLASSES; i++) {
+        seg_free[i] = heap_listp;
+        seg_rover[i] = heap_listp;
+    }
+    list_policy = mm_cfg.list_policy;
+    defer_coalesce = mm_cfg.defer_coalesce;
+    chunk_cur = ALIGN(mm_cfg.chunk_min);
+#ifndef MM_ARENAS
+    fresh_lo = fresh_hi = NULL;
+    fresh_ret_lo = fresh_ret_hi = NULL;
+#endif
+#ifdef MM_BITMAP
+    bm_nruns = bm_used = 0;
+    bm_free_id = -1;
+    for (i = 0; i < BM_NCLASSES; i++)
+        bm_partial[i] = -1;
+#endif
+    if (tag_nlive != 0 || tag_dropped != 0) {
+        memset(tag_tab, 0, sizeof(tag_tab));
+        memset(tag_bytes, 0, sizeof(tag_bytes));
+        memset(tag_blocks, 0, sizeof(tag_blocks));
+        tag_nlive = tag_dropped = 0;
+    }
+    prof_head = prof_count = 0;
+    prof_left = prof_rate;
+    st_nmalloc = st_nfree = st_nextend = st_nsample = 0;
+    st_live = st_peak_live = st_free_bytes = st_free_blocks = 0;
+    st_peak_heap = 0;
+    st_overhead = 4*WSIZE;
+    st_mapped = 0;
+    st_nmmap = 0;
+
+#ifdef MM_ARENAS
+    {
+        int a, c;
+        for (a = 0; a < MM_NARENAS; a++) {
+            for (c = 0; c < SEG_NCLASSES; c++) {
+                arenas[a].seg_free[c] = heap_listp;
+                arenas[a].seg_rover[c] = heap_listp;
+            }
+            pthread_mutex_init(&arenas[a].lock, NULL);
+            arenas[a].remote_head = 0;
+#ifdef MM_NUMA
+            arenas[a].node = -1;
+#endif
+        }
+        nregions = 0;
+        cur_arena = &arenas[0];
+    }
+#endif
+
+    /* Extend the empty heap with a free block of chunk_cur bytes */
+    if (extend_heap(chunk_cur/WSIZE) == NULL)
         return -1;
-    ;
+#ifdef MM_ARENAS
+    heap_ready = 1;
+#endif
+    return 0;
+}
+
+/*
+ * mm_default_config - Fills cfg with the defaults mm_init uses
+ */
+void mm_default_config(struct mm_config *cfg)
+{
+    cfg->chunk_min = CHUNKSIZE;
+    cfg->chunk_max = CHUNKMAX;
+    cfg->list_policy = MM_LIST_DEFAULT;
+    cfg->defer_coalesce = 0;
+    cfg->trim_threshold = 0;
+    cfg->mmap_threshold = MM_MMAP_THRESHOLD;
+    cfg->realloc_grow = 0;
+}
+
+/*
+ * mm_init_cfg - Initialize the memory manager with an explicit
+ * configuration; passing NULL gives the mm_init defaults
+ */
+int mm_init_cfg(const struct mm_config *cfg)
+{
+    if (cfg != NULL)
+        mm_cfg = *cfg;
+    else
+        mm_default_config(&mm_cfg);
+    if (mm_cfg.chunk_min < MINBLKSIZE)
+        mm_cfg.chunk_min = CHUNKSIZE;
+    if (mm_cfg.chunk_max < mm_cfg.chunk_min)
+        mm_cfg.chunk_max = mm_cfg.chunk_min;
+    if (mm_cfg.realloc_grow < 0)
+        mm_cfg.realloc_grow = 0;
+    return mm_init();
+}
+
+/*
+ * mm_attach - Backs the heap with the file at path. A valid image is
+ * remapped and its free lists rebuilt from the header page - the
+ * links inside blocks are base-relative offsets and need no fixup -
+ * then validated with the full mm_checkheap walk. Anything else
+ * (missing file, fresh file) becomes a new persistent heap. Returns
+ * 1 for a reattached image, 0 for a fresh heap, -1 on error; images
+ * without the clean flag or from a differently-configured build are
+ * refused, since their header roots cannot be trusted
+ */
+int mm_attach(const char *path)
+{
+#ifdef MM_ARENAS
+    /* The region table and per-arena state live outside the image;
+     * persistent mode is single-heap only */
+    (void)path;
+    return -1;
+#else
+    struct persist_hdr *ph;
+    struct stat stbuf;
+    unsigned short flags = 0;
+    int fd, i;
+
+    if (heap_listp != 0 || persist_base != NULL)
+        return -1;
+#ifdef MM_LARGEHEAP
+    flags |= MM_SNAPF_LARGEHEAP;
+#endif
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+        return -1;
+    if (fstat(fd, &stbuf) < 0) {
+        close(fd);
+        return -1;
+    }
+    persist_base = mmap(NULL, MM_PERSIST_RESERVE, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (persist_base == MAP_FAILED) {
+        persist_base = NULL;
+        close(fd);
+        return -1;
+    }
+    persist_fd = fd;
+    ph = (struct persist_hdr *)persist_base;
+
+    if ((size_t)stbuf.st_size > MM_PERSIST_PAGE &&
+        memcmp(ph->magic, MM_PERSIST_MAGIC, 4) == 0) {
+        if (ph->version != MM_PERSIST_VERSION || ph->flags != flags ||
+            !ph->clean || ph->heap_bytes + MM_PERSIST_PAGE >
+                          (size_t)stbuf.st_size) {
+            munmap(persist_base, MM_PERSIST_RESERVE);
+            persist_base = NULL;
+            persist_fd = -1;
+            close(fd);
+            return -1;
+        }
+        persist_brk = ph->heap_bytes;
+        heap_listp = persist_base + MM_PERSIST_PAGE + 2*WSIZE;
+        for (i = 0; i < SEG_NCLASSES; i++) {
+            seg_free[i] = (char *)COMP_ADDRESS(ph->seg_free[i]);
+            seg_rover[i] = heap_listp; /* Rovers are process state */
+        }
+        list_policy = ph->list_policy;
+        defer_coalesce = ph->defer_coalesce;
+        chunk_cur = ph->chunk_cur;
+        quarantine_head = ph->quarantine_head;
+        quarantine_count = ph->quarantine_count;
+        st_live = ph->st_live;
+        st_free_bytes = ph->st_free_bytes;
+        st_free_blocks = ph->st_free_blocks;
+        st_overhead = ph->st_overhead;
+        st_peak_live = st_live;
+        st_peak_heap = persist_brk;
+        st_nmalloc = st_nfree = st_nextend = st_nsample = 0;
+        st_mapped = 0;
+        st_nmmap = 0;
+        prof_head = prof_count = 0;
+        prof_left = prof_rate;
+        fresh_lo = fresh_hi = NULL;       /* Old pages are dirty */
+        fresh_ret_lo = fresh_ret_hi = NULL;
+#ifdef MM_BITMAP
+        /* Run bookkeeping is process state; mm_detach spilled the
+         * free slots, so the session starts with an empty table */
+        bm_nruns = bm_used = 0;
+        bm_free_id = -1;
+        for (i = 0; i < BM_NCLASSES; i++)
+            bm_partial[i] = -1;
+#endif
+        mm_cfg.mmap_threshold = 0;        /* Mapped blocks can't persist */
+        ph->clean = 0;                    /* Armed until mm_detach */
+        msync(persist_base, MM_PERSIST_PAGE, MS_SYNC);
+        mm_checkheap(0);                  /* Exits if the image is corrupt */
+        return 1;
+    }
+
+    /* Fresh heap in a fresh file */
+    if (ftruncate(fd, MM_PERSIST_PAGE) < 0) {
+        munmap(persist_base, MM_PERSIST_RESERVE);
+        persist_base = NULL;
+        persist_fd = -1;
+        close(fd);
+        return -1;
+    }
+    memset(ph, 0, sizeof(*ph));
+    memcpy(ph->magic, MM_PERSIST_MAGIC, 4);
+    ph->version = MM_PERSIST_VERSION;
+    ph->flags = flags;
+    persist_brk = 0;
+    mm_cfg.mmap_threshold = 0;
+    if (mm_init() != 0) {
+        munmap(persist_base, MM_PERSIST_RESERVE);
+        persist_base = NULL;
+        persist_fd = -1;
+        close(fd);
+        return -1;
+    }
+    return 0;
+#endif /* def MM_ARENAS */
+}
+
+/*
+ * mm_set_root / mm_get_root - The image remaps at a different base
+ * every run, so raw pointers into the old mapping are useless after
+ * reattach. The root is the one pointer the allocator translates for
+ * the application: point it at a block whose contents lead (by
+ * relative offsets) to everything else
+ */
+void mm_set_root(void *p)
+{
+#ifndef MM_ARENAS
+    if (persist_base != NULL)
+        ((struct persist_hdr *)persist_base)->root =
+            p != NULL ? COMP_OFFSET(p) : 0;
+#else
+    (void)p;
+#endif
+}
+
+void *mm_get_root(void)
+{
+#ifndef MM_ARENAS
+    if (persist_base != NULL &&
+        ((struct persist_hdr *)persist_base)->root != 0)
+        return (void *)COMP_ADDRESS(((struct persist_hdr *)persist_base)->root);
+#endif
+    return NULL;
+}
+
+/*
+ * mm_detach - Spills the list heads and counters into the header
+ * page, sets the clean flag, syncs and unmaps the image. The heap is
+ * gone after this; the next malloc lazily starts a fresh sbrk heap
+ */
+int mm_detach(void)
+{
+#ifndef MM_ARENAS
+    struct persist_hdr *ph = (struct persist_hdr *)persist_base;
+    int i;
+
+    if (persist_base == NULL)
+        return -1;
+#ifdef MM_TCACHE
+    for (i = 0; i < TC_NBINS; i++)
+        if (tcache[i].count > 0)
+            tcache_flush(&tcache[i], tcache[i].count);
+#endif
+#ifdef MM_BITMAP
+    /* Run bookkeeping is process state and does not survive into the
+     * image: spill every free slot back to the lists as an ordinary
+     * free block, then drop the table for the next session */
+    {
+        int pos;
+
+        for (pos = 0; pos < bm_nruns; pos++) {
+            struct bm_run *r = &bm_runs[bm_index[pos]];
+            unsigned long bits = r->bits;
+
+            while (bits != 0) {
+                int s = __builtin_ctzl(bits);
+
+                bits &= bits - 1;
+                free_slow(r->base + (size_t)s * r->asize);
+            }
+        }
+        bm_nruns = bm_used = 0;
+        bm_free_id = -1;
+        for (i = 0; i < BM_NCLASSES; i++)
+            bm_partial[i] = -1;
+    }
+#endif
+    for (i = 0; i < SEG_NCLASSES; i++)
+        ph->seg_free[i] = COMP_OFFSET(seg_free[i]);
+    ph->list_policy = list_policy;
+    ph->defer_coalesce = defer_coalesce;
+    ph->heap_bytes = persist_brk;
+    ph->chunk_cur = chunk_cur;
+    ph->quarantine_head = quarantine_head;
+    ph->quarantine_count = quarantine_count;
+    ph->st_live = st_live;
+    ph->st_free_bytes = st_free_bytes;
+    ph->st_free_blocks = st_free_blocks;
+    ph->st_overhead = st_overhead;
+    ph->clean = 1;
+    msync(persist_base, MM_PERSIST_PAGE + persist_brk, MS_SYNC);
+    munmap(persist_base, MM_PERSIST_RESERVE);
+    close(persist_fd);
+    persist_base = NULL;
+    persist_fd = -1;
+    persist_brk = 0;
+    heap_listp = 0;
     return 0;
+#else
+    return -1;
+#endif /* ndef MM_ARENAS */
+}
+
+#ifdef MM_ARENAS
+/*
+ * lazy_init - Thread-safe version of the lazy mm_init call that
+ * malloc and free make when the heap does not exist yet
+ */
+static void lazy_init(void)
+{
+    static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+    if (heap_ready)
+        return;
+    pthread_mutex_lock(&init_lock);
+    if (!heap_ready)
+        mm_init();
+    pthread_mutex_unlock(&init_lock);
+}
+
+#if defined(MM_NUMA) && defined(__linux__)
+/*
+ * numa_current_node - NUMA node the calling thread is running on,
+ * or -1 where the kernel cannot say
+ */
+static int numa_current_node(void)
+{
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+        return -1;
+    return (int)node;
+}
+
+/*
+ * numa_bind_span - Asks the kernel to place the whole pages inside
+ * [lo, lo+len) on node. Preferred policy, not bind: running out of
+ * local memory should spill, not fail
+ */
+static void numa_bind_span(void *lo, size_t len, int node)
+{
+    unsigned long mask;
+    size_t page = mem_pagesize();
+    char *p = (char *)(((size_t)lo + page-1) & ~(page-1));
+    char *end = (char *)(((size_t)lo + len) & ~(page-1));
+
+    if (node < 0 || node >= (int)(8*sizeof(mask)) || end <= p)
+        return;
+    mask = 1UL << node;
+    syscall(SYS_mbind, p, (size_t)(end - p), MPOL_PREFERRED,
+            &mask, 8*sizeof(mask), 0);
+}
+#endif /* MM_NUMA && __linux__ */
+
+/*
+ * arena_get - Returns the calling thread's home arena: one serving
+ * the thread's NUMA node when MM_NUMA can find or claim one,
+ * otherwise assigned round-robin on first use
+ */
+static struct arena *arena_get(void)
+{
+    if (my_arena == NULL) {
+#if defined(MM_NUMA) && defined(__linux__)
+        int node = numa_current_node();
+
+        if (node >= 0) {
+            unsigned int start = __sync_fetch_and_add(&arena_rr, 1);
+            int i;
+
+            for (i = 0; i < MM_NARENAS; i++) {
+                struct arena *a = &arenas[(start + i) % MM_NARENAS];
+
+                if (a->node == node) {
+                    my_arena = a;
+                    return my_arena;
+                }
+            }
+            for (i = 0; i < MM_NARENAS; i++) {
+                struct arena *a = &arenas[(start + i) % MM_NARENAS];
+
+                if (a->node == -1 &&
+                    __sync_bool_compare_and_swap(&a->node, -1, node)) {
+                    my_arena = a;
+                    return my_arena;
+                }
+            }
+        }
+#endif
+        my_arena = &arenas[__sync_fetch_and_add(&arena_rr, 1) % MM_NARENAS];
+    }
+    return my_arena;
+}
+
+/*
+ * block_arena - Maps a block to its owning arena via the region table
+ */
+static struct arena *block_arena(void *bp)
+{
+    int i;
+
+    for (i = nregions-1; i >= 0; i--) {
+        if ((char *)bp >= regions[i].lo && (char *)bp < regions[i].hi)
+            return &arenas[regions[i].arena];
+    }
+    return &arenas[0];
+}
+
+/*
+ * arena_remote_free - Pushes bp onto its home arena's remote stack
+ * with a compare-and-swap. The block stays marked allocated until the
+ * owner drains it, so the owner never sees a half-freed header
+ */
+static void arena_remote_free(struct arena *a, void *bp)
+{
+    mm_off_t off = (mm_off_t)COMP_OFFSET(bp);
+    mm_off_t old;
+
+    do {
+        old = a->remote_head;
+        *(mm_off_t *)bp = old;
+    } while (!__sync_bool_compare_and_swap(&a->remote_head, old, off));
+}
+
+/*
+ * arena_drain - Frees everything on the arena's remote stack.
+ * Caller holds the arena lock
+ */
+static void arena_drain(struct arena *a)
+{
+    mm_off_t off = __sync_lock_test_and_set(&a->remote_head, 0);
+
+    while (off != 0) {
+        char *bp = (char *)COMP_ADDRESS(off);
+
+        off = *(mm_off_t *)bp;
+        mark_free(bp);
+        growth_decay(coalesce(bp));
+    }
 }
+#endif /* def MM_ARENAS */
 
 /* 
  *  * malloc - Allocate a block with at least size bytes of payload 
  *   */
-void *malloc(size_t size) 
+void *malloc(size_t size)
 {
-    size_t asize;      /* Adjusted block size */
-    size_t extendsize; /* Amount to extend heap if no fit */
-    char *bp;      
+    void *bp = NULL;
 
-    if (heap_listp == 0){
-        mm_init();
-    }
     /* Ignore spurious requests */
     if (size == 0)
         return NULL;
 
+    /* Refuse sizes no allocation could satisfy before any rounding
+     * here or downstream can wrap (glibc draws the same line, at
+     * PTRDIFF_MAX) */
+    if (size > ((size_t)-1 >> 1))
+        return NULL;
+
+    /* Large requests bypass the free lists and get their own mapping;
+     * if the map fails, fall through to the sbrk heap */
+    if (mm_cfg.mmap_threshold != 0 && size >= mm_cfg.mmap_threshold)
+        bp = map_alloc(size);
+
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= MINBLKSIZE)                        
-        asize = 3*DSIZE;                                        
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); 
+    if (bp == NULL)
+        bp = mm_malloc_prepared(adjust_size(size));
+    TRACE_EVENT(MM_TR_MALLOC, size, NULL, bp);
+    return bp;
+}
+
+/*
+ * map_alloc - Serves one block from its own anonymous mapping. The
+ * prefix records the map length and fakes a header carrying the
+ * mapped bit, so free/realloc can tell these blocks apart from heap
+ * blocks with the header read they already do
+ */
+static void *map_alloc(size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t len;
+    struct map_prefix *mp;
+
+    /* The prefix-and-page rounding below must not wrap */
+    if (size > (size_t)-1 - sizeof(struct map_prefix) - page)
+        return NULL;
+    len = (size + sizeof(struct map_prefix) + page - 1) & ~(page - 1);
+
+    mp = mmap(NULL, len, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mp == MAP_FAILED)
+        return NULL;
+    mp->len = len;
+    mp->hdr = PACK(0, 1) | 0x4;
+    st_nmalloc++;
+    st_nmmap++;
+    st_mapped += len;
+    return mp + 1;
+}
+
+/*
+ * map_free - Releases a directly-mapped block wholesale
+ */
+static void map_free(void *bp)
+{
+    struct map_prefix *mp = (struct map_prefix *)bp - 1;
+    size_t len = mp->len;
+
+    st_mapped -= len;
+    munmap(mp, len);
+}
+
+/*
+ * mm_malloc_prepared - malloc taking a size that has already been
+ * rounded up to a legal block size (MM_SIZED_ASIZE in mm_ext.h does
+ * that rounding at compile time for the mm_malloc_sized entry
+ * points). Everything size-dependent up to the list-head pop has been
+ * resolved by the caller
+ */
+void *mm_malloc_prepared(size_t asize)
+{
+    size_t extendsize; /* Amount to extend heap if no fit */
+    char *bp;
+    int sampled = 0;
+    unsigned long t0 = 0;
+
+#ifdef MM_ARENAS
+    lazy_init();
+#else
+    if (heap_listp == 0){
+        mm_init();
+    }
+#endif
+    st_nmalloc++;
+    if (prof_rate != 0 && --prof_left == 0) {
+        prof_left = prof_rate;
+        sampled = 1;
+        t0 = prof_cycles();
+    }
+
+#ifdef MM_TCACHE
+    struct tcache_bin *tc_bin = NULL;
+
+    if (asize <= TC_MAXSIZE) {
+        tc_bin = &tcache[TC_BIN(asize)];
+        if (tc_bin->head != 0) {
+            bp = (char *)COMP_ADDRESS(tc_bin->head);
+            tc_bin->head = *(mm_off_t *)bp;
+            tc_bin->count--;
+#ifndef MM_ARENAS
+            fresh_ret_lo = fresh_ret_hi = NULL; /* Recycled: dirty */
+#endif
+            if (sampled)
+                prof_record(MM_PROF_MALLOC, asize, prof_cycles() - t0,
+                            MM_FIT_TCACHE);
+            return bp;
+        }
+    }
+#endif
+
+#ifdef MM_BITMAP
+    /* Small sizes come out of a run bitmap: find-first-set and a bit
+     * clear, no list walk. A miss (run table full, heap cannot grow)
+     * falls through to the lists */
+    if (asize >= BM_MINSIZE && asize <= BM_MAXSIZE) {
+        bp = bm_malloc(asize);
+        if (bp != NULL) {
+            fresh_ret_lo = fresh_ret_hi = NULL; /* Recycled: dirty */
+            if (sampled)
+                prof_record(MM_PROF_MALLOC, asize, prof_cycles() - t0,
+                            MM_FIT_LIST);
+            return bp;
+        }
+    }
+#endif
+
+#ifdef MM_ARENAS
+    cur_arena = arena_get();
+    pthread_mutex_lock(&cur_arena->lock);
+    arena_drain(cur_arena);
+#endif
 
     /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL) {  
-        place(bp, asize);                  
-        ;
+    bp = find_fit(asize);
+#ifndef MM_ARENAS
+    /* A failed search under deferred coalescing merges the
+     * quarantine and retries before growing the heap */
+    if (bp == NULL && quarantine_head != 0) {
+        quarantine_drain();
+        bp = find_fit(asize);
+    }
+#endif
+    if (bp != NULL) {
+        place(bp, asize);
+#ifndef MM_ARENAS
+        fresh_consume(bp, asize);
+#endif
+#ifdef MM_TCACHE
+        if (tc_bin != NULL)
+            tcache_fill(tc_bin, asize, MM_TCACHE_BATCH);
+#endif
+#ifdef MM_ARENAS
+        pthread_mutex_unlock(&cur_arena->lock);
+#endif
+        if (sampled)
+            prof_record(MM_PROF_MALLOC, asize, prof_cycles() - t0,
+                        MM_FIT_LIST);
         return bp;
     }
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);                 
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
-        return NULL;                                  
-    place(bp, asize);                                 
-    
+    /* No fit found. Get more memory and place the block. Sustained
+     * pressure grows the extension size geometrically so ramping
+     * heaps stop paying a mem_sbrk round trip per CHUNKSIZE */
+    extendsize = MAX(asize,chunk_cur);
+    if ((bp = extend_heap(extendsize/WSIZE)) == NULL) {
+#ifdef MM_ARENAS
+        pthread_mutex_unlock(&cur_arena->lock);
+#endif
+        if (sampled)
+            prof_record(MM_PROF_MALLOC, asize, prof_cycles() - t0,
+                        MM_FIT_FAIL);
+        return NULL;
+    }
+    if (chunk_cur < mm_cfg.chunk_max)
+        chunk_cur = MAX(chunk_cur * 2, mm_cfg.chunk_min);
+    place(bp, asize);
+#ifndef MM_ARENAS
+    fresh_consume(bp, asize);
+#endif
+#ifdef MM_TCACHE
+    if (tc_bin != NULL)
+        tcache_fill(tc_bin, asize, MM_TCACHE_BATCH);
+#endif
+#ifdef MM_ARENAS
+    pthread_mutex_unlock(&cur_arena->lock);
+#endif
+
+    if (sampled)
+        prof_record(MM_PROF_MALLOC, asize, prof_cycles() - t0,
+                    MM_FIT_EXTEND);
     return bp;
-} 
+}
+
+
+
+#ifdef MM_HARDEN
+/*
+ * harden_check - Validates a pointer the caller claims came from
+ * malloc before the allocator touches any list with it: alignment,
+ * the allocated bit (clear means double free), the canary bit (never
+ * set on anything malloc did not return), a legal size, and the next
+ * block's prev-alloc bit, which an overflow through this block's
+ * header would scramble. A handful of compares, cheap enough to
+ * leave on in production. Follows mm_checkheap's convention on
+ * corruption: print and exit
+ */
+static void harden_check(void *bp)
+{
+    unsigned int hdr;
+
+    if ((size_t)bp % 8) {
+        printf("Harden: %p is not a payload address\n", bp);
+        exit(0);
+    }
+    hdr = GET(HDRP(bp));
+    if ((hdr & 0x7) == 0x5 && GET_SIZE(HDRP(bp)) == 0)
+        return;                /* Directly mapped: no heap neighbors */
+    if (!(hdr & 0x1)) {
+        printf("Harden: double free of %p\n", bp);
+        exit(0);
+    }
+    if (!(hdr & 0x4) || GET_SIZE(HDRP(bp)) < MINBLKSIZE ||
+        GET_SIZE(HDRP(bp)) > heap_size()) {
+        printf("Harden: %p carries no allocation canary\n", bp);
+        exit(0);
+    }
+    if (!GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+        printf("Harden: header of %p is corrupt (overflow suspected)\n",
+               bp);
+        exit(0);
+    }
+}
+#endif /* def MM_HARDEN */
+
+/*
+ *  * free - Free a block
+ *   */
+void free(void *bp)
+{
+    int sampled = 0;
+    unsigned long t0 = 0;
+
+    if(bp == 0)
+        return;
+
+    TRACE_EVENT(MM_TR_FREE, 0, bp, NULL);
+#ifdef MM_HARDEN
+    harden_check(bp);
+#endif
+    if (tag_nlive != 0)
+        tag_remove(bp);
+    st_nfree++;
+    if (IS_MAPPED(HDRP(bp))) {
+        map_free(bp);
+        return;
+    }
+    if (prof_rate != 0 && --prof_left == 0) {
+        prof_left = prof_rate;
+        sampled = 1;
+        t0 = prof_cycles();
+    }
+
+#ifdef MM_TCACHE
+    {
+        size_t bsz = GET_SIZE(HDRP(bp));
+
+        if (bsz >= TC_MINSIZE && bsz <= TC_MAXSIZE) {
+            struct tcache_bin *bin = &tcache[TC_BIN(bsz)];
+
+#ifdef MM_HARDEN
+            /* Cached blocks stay marked allocated, so the alloc-bit
+             * test misses a repeated free; the bin head catches the
+             * common immediate case */
+            if (bin->head == (mm_off_t)(COMP_OFFSET(bp))) {
+                printf("Harden: double free of %p\n", bp);
+                exit(0);
+            }
+#endif
+            if (bin->count >= MM_TCACHE_CAP)
+                tcache_flush(bin, MM_TCACHE_CAP/2);
+            *(mm_off_t *)bp = bin->head;
+            bin->head = (mm_off_t)COMP_OFFSET(bp);
+            bin->count++;
+            if (sampled)
+                prof_record(MM_PROF_FREE, bsz, prof_cycles() - t0,
+                            MM_FIT_TCACHE);
+            return;
+        }
+    }
+#endif
+#ifdef MM_BITMAP
+    {
+        size_t bsz = GET_SIZE(HDRP(bp));
+
+        /* A run's last slot can be up to MINBLKSIZE-DSIZE over
+         * BM_MAXSIZE; the size test is only a cheap pre-filter, the
+         * table lookup decides */
+        if (bsz >= BM_MINSIZE && bsz < BM_MAXSIZE + MINBLKSIZE &&
+            bm_free(bp)) {
+            if (sampled)
+                prof_record(MM_PROF_FREE, bsz, prof_cycles() - t0,
+                            MM_FIT_LIST);
+            if (mm_cfg.trim_threshold != 0)
+                trim_maybe();
+            return;
+        }
+    }
+#endif
+    {
+        size_t bsz = GET_SIZE(HDRP(bp));
+
+        free_slow(bp);
+        if (sampled)
+            prof_record(MM_PROF_FREE, bsz, prof_cycles() - t0,
+                        MM_FIT_LIST);
+    }
+    if (mm_cfg.trim_threshold != 0)
+        trim_maybe();
+}
+
+/*
+ * trim_maybe - Cheap auto-trim check: two loads against the top of
+ * the heap before committing to the real mm_trim
+ */
+static void trim_maybe(void)
+{
+    char *brkp = (char *)heap_hi() + 1;
+
+    if (GET_PREV_ALLOC(brkp - WSIZE))
+        return;
+    if (GET_SIZE(brkp - DSIZE) < mm_cfg.trim_threshold)
+        return;
+    mm_trim(mm_cfg.trim_threshold / 2);
+}
+
+/*
+ * mm_trim - Gives the free space at the top of the heap back to the
+ * system through a negative mem_sbrk, keeping pad bytes in reserve.
+ * Returns the number of bytes released
+ */
+size_t mm_trim(size_t pad)
+{
+    char *brkp, *tp;
+    size_t s, keep, delta;
+
+    if (heap_listp == 0)
+        return 0;
+#ifdef MM_ARENAS
+    struct arena *home;
+
+    brkp = (char *)heap_hi() + 1;
+    if (GET_PREV_ALLOC(brkp - WSIZE))
+        return 0;
+    tp = brkp - GET_SIZE(brkp - DSIZE);
+    home = block_arena(tp);
+    cur_arena = home;
+    pthread_mutex_lock(&home->lock);
+    pthread_mutex_lock(&heap_lock);
+    /* The top may have changed before the locks were taken */
+    brkp = (char *)heap_hi() + 1;
+    if (GET_PREV_ALLOC(brkp - WSIZE) ||
+        block_arena(brkp - GET_SIZE(brkp - DSIZE)) != home) {
+        pthread_mutex_unlock(&heap_lock);
+        pthread_mutex_unlock(&home->lock);
+        return 0;
+    }
+#else
+    brkp = (char *)heap_hi() + 1;
+    if (GET_PREV_ALLOC(brkp - WSIZE))
+        return 0;
+#endif
+    s = GET_SIZE(brkp - DSIZE);  /* Top free block's footer */
+    tp = brkp - s;
+    keep = ALIGN(pad);
+    if (keep > 0 && keep < MINBLKSIZE)
+        keep = MINBLKSIZE;
+    if (s <= keep) {
+        delta = 0;
+        goto out;
+    }
+    delta = s - keep;
+    if (delta > ((size_t)1 << 30)) {  /* mem_sbrk takes an int */
+        delta = (size_t)1 << 30;
+        keep = s - delta;
+    }
+    /* Unlink and rewrite under the new top BEFORE the break moves: on
+     * a persistent heap the shrink truncates the image file, and the
+     * block's link words can sit on the very page being cut, so
+     * touching them afterwards faults. The order is harmless for the
+     * sbrk build */
+    freelist_remove(tp);
+    if (keep == 0) {
+        /* Whole block released: the epilogue lands on its header */
+        PUT(HDRP(tp), PACK(0, 1) | GET_PREV_ALLOC(HDRP(tp)));
+    }
+    else {
+        PUT(HDRP(tp), PACK(keep, 0) | GET_PREV_ALLOC(HDRP(tp)));
+        PUT(FTRP(tp), PACK(keep, 0));
+        freelist_add(tp);
+        PUT(HDRP(NEXT_BLKP(tp)), PACK(0, 1)); /* New epilogue header */
+    }
+    if (heap_sbrk(-(int)delta) == (void *)-1) {
+        /* Shrink refused: restore the block at its full size */
+        if (keep != 0)
+            freelist_remove(tp);
+        PUT(HDRP(tp), PACK(s, 0) | GET_PREV_ALLOC(HDRP(tp)));
+        PUT(FTRP(tp), PACK(s, 0));
+        freelist_add(tp);
+        delta = 0;
+        goto out;
+    }
+#ifdef MM_ARENAS
+    if (nregions > 0)
+        regions[nregions-1].hi -= delta;
+#else
+    /* The released span (and the rewritten footer/epilogue under the
+     * new top) can no longer be assumed zero */
+    if (fresh_hi > tp + keep - DSIZE)
+        fresh_hi = tp + keep - DSIZE;
+#endif
+out:
+#ifdef MM_ARENAS
+    pthread_mutex_unlock(&heap_lock);
+    pthread_mutex_unlock(&home->lock);
+#endif
+    return delta;
+}
+
+/*
+ *  * free_slow - Free a block through the full list path
+ *   */
+static void free_slow(void *bp)
+{
+#ifdef MM_ARENAS
+    struct arena *home;
+
+    lazy_init();
+    home = block_arena(bp);
+    if (home != my_arena || defer_coalesce) {
+        /* Foreign thread (or deferred-coalescing mode): hand the
+         * block to its home arena's remote stack without taking any
+         * lock; the owner merges it in a batch on its next malloc */
+        arena_remote_free(home, bp);
+        return;
+    }
+    cur_arena = home;
+    pthread_mutex_lock(&home->lock);
+    mark_free(bp);
+    growth_decay(coalesce(bp));
+    pthread_mutex_unlock(&home->lock);
+#else
+    if (heap_listp == 0){
+        mm_init();
+    }
+
+    if (defer_coalesce) {
+#ifdef MM_HARDEN
+        /* Quarantined blocks stay marked allocated; catch the
+         * immediate repeat like the tcache bins do */
+        if (quarantine_head == (mm_off_t)(COMP_OFFSET(bp))) {
+            printf("Harden: double free of %p\n", bp);
+            exit(0);
+        }
+#endif
+        /* Just a list push; the block keeps its allocated header so
+         * nothing tries to merge with it before the batch runs */
+        *(mm_off_t *)bp = quarantine_head;
+        quarantine_head = (mm_off_t)COMP_OFFSET(bp);
+        if (++quarantine_count >= MM_QUARANTINE_MAX)
+            quarantine_drain();
+        return;
+    }
+
+    mark_free(bp);
+    growth_decay(coalesce(bp));
+    ;
+#endif
+}
+
+#ifndef MM_ARENAS
+/*
+ * quarantine_drain - Flips and coalesces every quarantined block in
+ * one batch
+ */
+static void quarantine_drain(void)
+{
+    mm_off_t off = quarantine_head;
+
+    quarantine_head = 0;
+    quarantine_count = 0;
+    while (off != 0) {
+        char *bp = (char *)COMP_ADDRESS(off);
+
+        off = *(mm_off_t *)bp;
+        mark_free(bp);
+        growth_decay(coalesce(bp));
+    }
+}
+#endif
+
+/*
+ * mm_coalesce_all - Merges every deferred free immediately
+ */
+void mm_coalesce_all(void)
+{
+#ifdef MM_ARENAS
+    int a;
+
+    for (a = 0; a < MM_NARENAS; a++) {
+        pthread_mutex_lock(&arenas[a].lock);
+        cur_arena = &arenas[a];
+        arena_drain(&arenas[a]);
+        pthread_mutex_unlock(&arenas[a].lock);
+    }
+    cur_arena = my_arena;
+#else
+    quarantine_drain();
+#endif
+}
+
+/*
+ * maint_now - Monotonic nanoseconds for maintenance budgets. Wall
+ * time rather than cycles: budgets are latency promises to the
+ * caller's event loop, not throughput measurements
+ */
+static unsigned long maint_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL +
+           (unsigned long)ts.tv_nsec;
+}
+
+/*
+ * mm_maintain - Runs pending maintenance in bounded slices: merges
+ * deferred frees one block (one arena under MM_ARENAS) at a time,
+ * flushes overfull thread-cache bins back to half capacity, and trims
+ * the heap top once, rechecking the budget between steps so inline
+ * malloc/free never pays for the sweeps. Returns the number of steps
+ * taken; 0 means the allocator is caught up. A zero budget means
+ * unbounded
+ */
+size_t mm_maintain(unsigned long budget_ns)
+{
+    unsigned long t0 = maint_now();
+    size_t done = 0;
+
+    if (heap_listp == 0)
+        return 0;
+#ifdef MM_ARENAS
+    {
+        int a;
+
+        for (a = 0; a < MM_NARENAS; a++) {
+            struct arena *ar = &arenas[a];
+
+            if (ar->remote_head == 0)
+                continue;
+            /* Contended arenas are busy serving requests; skip them
+             * rather than stall whoever holds the lock */
+            if (pthread_mutex_trylock(&ar->lock) != 0)
+                continue;
+            cur_arena = ar;
+            arena_drain(ar);
+            pthread_mutex_unlock(&ar->lock);
+            done++;
+            if (budget_ns != 0 && maint_now() - t0 >= budget_ns) {
+                cur_arena = my_arena;
+                return done;
+            }
+        }
+        cur_arena = my_arena;
+    }
+#else
+    while (quarantine_head != 0) {
+        char *bp = (char *)COMP_ADDRESS(quarantine_head);
+
+        quarantine_head = *(mm_off_t *)bp;
+        quarantine_count--;
+        mark_free(bp);
+        growth_decay(coalesce(bp));
+        done++;
+        if (budget_ns != 0 && maint_now() - t0 >= budget_ns)
+            return done;
+    }
+#endif
+#ifdef MM_TCACHE
+    {
+        int b;
+
+        for (b = 0; b < TC_NBINS; b++) {
+            if (tcache[b].count <= MM_TCACHE_CAP/2)
+                continue;
+            tcache_flush(&tcache[b], tcache[b].count - MM_TCACHE_CAP/2);
+            done++;
+            if (budget_ns != 0 && maint_now() - t0 >= budget_ns)
+                return done;
+        }
+    }
+#endif
+    if (mm_cfg.trim_threshold != 0) {
+        char *brkp = (char *)heap_hi() + 1;
+
+        if (!GET_PREV_ALLOC(brkp - WSIZE) &&
+            GET_SIZE(brkp - DSIZE) >= mm_cfg.trim_threshold &&
+            mm_trim(mm_cfg.trim_threshold / 2) > 0)
+            done++;
+    }
+    return done;
+}
+
+#ifdef MM_ARENAS
+static pthread_t maint_tid;
+static volatile int maint_running;
+static unsigned int maint_interval_ms;
+static unsigned long maint_budget_ns;
+
+static void *maint_loop(void *arg)
+{
+    (void)arg;
+    while (maint_running) {
+        struct timespec ts = { maint_interval_ms / 1000,
+                               (long)(maint_interval_ms % 1000) * 1000000L };
+
+        mm_maintain(maint_budget_ns);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+#endif
+
+/*
+ * mm_maintenance_start / mm_maintenance_stop - Dedicated maintenance
+ * thread pumping mm_maintain on an interval. Only MM_ARENAS builds
+ * have the locking to share the heap with one; elsewhere start
+ * returns -1 and the application pumps mm_maintain itself
+ */
+int mm_maintenance_start(unsigned int interval_ms, unsigned long budget_ns)
+{
+#ifdef MM_ARENAS
+    lazy_init();
+    if (maint_running)
+        return 0;
+    maint_interval_ms = interval_ms != 0 ? interval_ms : 10;
+    maint_budget_ns = budget_ns;
+    maint_running = 1;
+    if (pthread_create(&maint_tid, NULL, maint_loop, NULL) != 0) {
+        maint_running = 0;
+        return -1;
+    }
+    return 0;
+#else
+    (void)interval_ms;
+    (void)budget_ns;
+    return -1;
+#endif
+}
+
+void mm_maintenance_stop(void)
+{
+#ifdef MM_ARENAS
+    if (!maint_running)
+        return;
+    maint_running = 0;
+    pthread_join(maint_tid, NULL);
+#endif
+}
+
+static mm_move_cb move_cb;  /* Application's relocation consent hook */
+static void *move_ctx;
+
+/*
+ * mm_register_move_cb - Registers the callback mm_compact asks before
+ * relocating a block; NULL disables compaction
+ */
+void mm_register_move_cb(mm_move_cb cb, void *ctx)
+{
+    move_cb = cb;
+    move_ctx = ctx;
+}
+
+/*
+ * mm_compact - Slides movable allocations down into the free gap
+ * directly below them, coalescing the vacated space upward - the only
+ * cure for free blocks pinned between long-lived allocations, which
+ * coalesce alone can never merge. One linear walk, at most max_moves
+ * relocations. Each candidate is offered to the registered callback
+ * with its old and new payload addresses; a zero return is consent,
+ * after which the allocator memmoves the payload and the application
+ * must use the new address. The callback must refuse pointers it does
+ * not recognize - that is also what keeps thread-cached blocks, which
+ * stay marked allocated, where they are. Run slots (MM_BITMAP) and
+ * region fences are skipped outright. Like mm_snapshot, the walk
+ * takes no locks: quiesce other threads first on an MM_ARENAS heap
+ */
+size_t mm_compact(size_t max_moves)
+{
+    char *bp;
+    size_t moved = 0;
+
+    if (heap_listp == 0 || move_cb == NULL)
+        return 0;
+    mm_coalesce_all();
+#ifdef MM_TCACHE
+    {
+        int b;
+
+        for (b = 0; b < TC_NBINS; b++)
+            tcache_flush(&tcache[b], tcache[b].count);
+    }
+#endif
+#ifndef MM_ARENAS
+    /* Payloads slide over the known-zero span */
+    fresh_lo = fresh_hi = NULL;
+    fresh_ret_lo = fresh_ret_hi = NULL;
+#endif
+
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0 && moved < max_moves;
+         bp = NEXT_BLKP(bp)) {
+        char *fp, *np;
+        size_t asz, fsz;
+
+        /* A movable candidate is an ordinary allocated block sitting
+         * directly above a free one (fences are DSIZE, real blocks
+         * never are) */
+        if (!GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) <= DSIZE ||
+            GET_PREV_ALLOC(HDRP(bp)))
+            continue;
+#ifdef MM_BITMAP
+        if (bm_lookup(bp) >= 0)
+            continue;
+#endif
+        fp = PREV_BLKP(bp);
+        asz = GET_SIZE(HDRP(bp));
+        fsz = GET_SIZE(HDRP(fp));
+        if (move_cb(move_ctx, bp, fp, asz - WSIZE) != 0)
+            continue;
+
+        /* A moved block's tag charge follows it to the new address,
+         * the same migration realloc performs */
+        unsigned int tag = tag_nlive != 0 ? tag_remove(bp) : 0;
+
+        freelist_remove(fp);
+        memmove(fp, bp, asz - WSIZE);
+        PUT(HDRP(fp), PACK(asz, ALLOCBITS) | GET_PREV_ALLOC(HDRP(fp)));
+        if (tag != 0)
+            tag_insert(fp, tag);
+        np = NEXT_BLKP(fp);
+        PUT(HDRP(np), PACK(fsz, 0) | 0x2);
+        PUT(FTRP(np), PACK(fsz, 0));
+        CLR_PREV_ALLOC(HDRP(NEXT_BLKP(np)));
+        coalesce(np);
+        moved++;
+        bp = fp; /* Resume from the relocated block */
+    }
+    return moved;
+}
+
+static void tag_insert(void *bp, unsigned int tag)
+{
+    size_t i = TAG_HASH(bp), n;
+
+#ifdef MM_ARENAS
+    pthread_mutex_lock(&tag_lock);
+#endif
+    for (n = 0; n < MM_TAGTAB; n++, i = (i + 1) & (MM_TAGTAB - 1)) {
+        if (tag_tab[i].ptr == NULL || tag_tab[i].ptr == TAG_DEAD) {
+            tag_tab[i].ptr = bp;
+            tag_tab[i].size = mm_usable_size(bp);
+            tag_tab[i].tag = tag;
+            tag_bytes[tag] += tag_tab[i].size;
+            tag_blocks[tag]++;
+            tag_nlive++;
+#ifdef MM_ARENAS
+            pthread_mutex_unlock(&tag_lock);
+#endif
+            return;
+        }
+    }
+    tag_dropped++;  /* Block stays usable, just uncharged */
+#ifdef MM_ARENAS
+    pthread_mutex_unlock(&tag_lock);
+#endif
+}
+
+/*
+ * tag_remove - Drops bp's charge if it carries one and returns its
+ * tag, 0 for untagged blocks. Callers skip this entirely while
+ * tag_nlive is 0
+ */
+static unsigned int tag_remove(void *bp)
+{
+    size_t i = TAG_HASH(bp), n;
+    unsigned int tag = 0;
+
+#ifdef MM_ARENAS
+    pthread_mutex_lock(&tag_lock);
+#endif
+    for (n = 0; n < MM_TAGTAB; n++, i = (i + 1) & (MM_TAGTAB - 1)) {
+        if (tag_tab[i].ptr == NULL)
+            break;
+        if (tag_tab[i].ptr == bp) {
+            tag = tag_tab[i].tag;
+            tag_bytes[tag] -= tag_tab[i].size;
+            tag_blocks[tag]--;
+            tag_nlive--;
+            tag_tab[i].ptr = TAG_DEAD;
+            break;
+        }
+    }
+#ifdef MM_ARENAS
+    pthread_mutex_unlock(&tag_lock);
+#endif
+    return tag;
+}
+
+/*
+ * mm_malloc_tagged - malloc that charges the block to a tag so RSS
+ * growth can be attributed per subsystem. Tag 0 (and anything out of
+ * range) is plain malloc
+ */
+void *mm_malloc_tagged(size_t size, unsigned int tag)
+{
+    void *bp = malloc(size);
+
+    if (bp != NULL && tag != 0 && tag <= MM_TAGMAX)
+        tag_insert(bp, tag);
+    return bp;
+}
+
+/*
+ * mm_tag_live - Reads one tag's counters; returns live bytes and
+ * stores the live block count through blocks when non-NULL
+ */
+size_t mm_tag_live(unsigned int tag, size_t *blocks)
+{
+    if (tag > MM_TAGMAX) {
+        if (blocks != NULL)
+            *blocks = 0;
+        return 0;
+    }
+    if (blocks != NULL)
+        *blocks = tag_blocks[tag];
+    return tag_bytes[tag];
+}
+
+/*
+ * mm_tag_report - Dumps every tag with a live charge to stdout
+ */
+void mm_tag_report(void)
+{
+    size_t tagged = 0;
+    unsigned int t;
+
+    printf("tag  live-bytes  live-blocks\n");
+    for (t = 1; t <= MM_TAGMAX; t++) {
+        if (tag_blocks[t] != 0)
+            printf("%3u  %10zu  %11zu\n", t, tag_bytes[t], tag_blocks[t]);
+        tagged += tag_bytes[t];
+    }
+    printf("tagged %zu of %zu live bytes\n", tagged, st_live);
+    if (tag_dropped != 0)
+        printf("(%zu tags dropped: table full)\n", tag_dropped);
+}
+
+/* Epochs: request-scoped bulk free. An epoch collects payload
+ * pointers in a growable array (itself heap-allocated, outside any
+ * epoch) and releases them through mm_free_batch's address-sorted
+ * single-pass sweep, so a request handler's teardown is one call
+ * instead of n free()s. Epochs nest; the innermost open one is the
+ * current epoch. The whole mechanism is thread-local - an epoch is
+ * begun, filled and released by one thread, which is also what makes
+ * it safe without taking any allocator lock. */
+#ifndef MM_MAXEPOCHS
+#define MM_MAXEPOCHS 16
+#endif
+#define EPOCH_MINCAP 64
+
+struct epoch {
+    void **ptrs;
+    size_t n, cap;
+    int parent;     /* Enclosing open epoch, -1 at the bottom */
+    int open;
+};
+
+static __thread struct epoch epochs[MM_MAXEPOCHS];
+static __thread int epoch_cur = -1;
+
+/*
+ * mm_epoch_begin - Opens an epoch and makes it current. Returns its
+ * handle, or -1 when all MM_MAXEPOCHS slots are open
+ */
+int mm_epoch_begin(void)
+{
+    int i;
+
+    for (i = 0; i < MM_MAXEPOCHS; i++) {
+        if (!epochs[i].open) {
+            epochs[i].open = 1;
+            epochs[i].n = 0;
+            epochs[i].parent = epoch_cur;
+            epoch_cur = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * mm_epoch_track - Attributes a block to the current epoch, to be
+ * freed by its release. Returns 0, or -1 when no epoch is open or
+ * the tracking array cannot grow. Freeing (or reallocating) a
+ * tracked block before the release leaves a stale entry the sweep
+ * will free again - hand such blocks their own epoch instead
+ */
+int mm_epoch_track(void *ptr)
+{
+    struct epoch *e;
+
+    if (ptr == NULL || epoch_cur < 0)
+        return -1;
+    e = &epochs[epoch_cur];
+    if (e->n == e->cap) {
+        size_t ncap = e->cap != 0 ? e->cap * 2 : EPOCH_MINCAP;
+        void **np;
+
+        TRACE_SUSPEND();
+        np = realloc(e->ptrs, ncap * sizeof(void *));
+        TRACE_RESUME();
+        if (np == NULL)
+            return -1;
+        e->ptrs = np;
+        e->cap = ncap;
+    }
+    e->ptrs[e->n++] = ptr;
+    return 0;
+}
+
+/*
+ * mm_epoch_malloc - malloc attributed to the current epoch; with
+ * none open it is plain malloc. NULL when the block or its tracking
+ * slot cannot be had
+ */
+void *mm_epoch_malloc(size_t size)
+{
+    void *bp = malloc(size);
+
+    if (bp != NULL && epoch_cur >= 0 && mm_epoch_track(bp) != 0) {
+        free(bp);
+        return NULL;
+    }
+    return bp;
+}
+
+/*
+ * mm_epoch_release - Frees everything the epoch collected in one
+ * address-sorted sweep and retires the handle. Returns the number of
+ * blocks released. Releasing out of LIFO order is allowed; enclosed
+ * epochs still open are reparented, not released
+ */
+size_t mm_epoch_release(int h)
+{
+    struct epoch *e;
+    size_t n;
+    int i;
+
+    if (h < 0 || h >= MM_MAXEPOCHS || !epochs[h].open)
+        return 0;
+    e = &epochs[h];
+    n = e->n;
+    if (n != 0) {
+        TRACE_SUSPEND();
+        mm_free_batch(e->ptrs, n);
+        free(e->ptrs);
+        TRACE_RESUME();
+    }
+    else if (e->ptrs != NULL) {
+        TRACE_SUSPEND();
+        free(e->ptrs);
+        TRACE_RESUME();
+    }
+    e->ptrs = NULL;
+    e->cap = 0;
+    e->open = 0;
+    if (epoch_cur == h)
+        epoch_cur = e->parent;
+    else
+        for (i = 0; i < MM_MAXEPOCHS; i++)
+            if (epochs[i].open && epochs[i].parent == h)
+                epochs[i].parent = e->parent;
+    return n;
+}
+
+/*
+ * mm_set_defer_coalesce - Turns deferred coalescing on or off;
+ * turning it off drains whatever is queued
+ */
+void mm_set_defer_coalesce(int on)
+{
+    defer_coalesce = on;
+    if (!on && heap_listp != 0)
+        mm_coalesce_all();
+}
+
+/*
+ * mark_free - Flips an allocated block to free: rewrites the header
+ * keeping the prev-alloc bit, writes the free-block footer, and
+ * clears the prev-alloc bit in the following block's header
+ */
+static void mark_free(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    st_live -= size;
+    PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp)));
+    PUT(FTRP(bp), PACK(size, 0));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+}
+
+#ifdef MM_TCACHE
+/*
+ * tcache_fill - Carves up to n more blocks of asize out of the free
+ * lists into the bin. Called on a bin miss while the slow path (and
+ * any arena lock) is already active, so the batch costs one traversal
+ * setup instead of n
+ */
+static void tcache_fill(struct tcache_bin *bin, size_t asize, int n)
+{
+    void *fp;
+
+    while (n-- > 0 && bin->count < MM_TCACHE_CAP) {
+        if ((fp = find_fit(asize)) == NULL)
+            return;
+        place(fp, asize);
+#ifndef MM_ARENAS
+        fresh_consume(fp, asize);
+#endif
+        *(mm_off_t *)fp = bin->head;
+        bin->head = (mm_off_t)COMP_OFFSET(fp);
+        bin->count++;
+    }
+}
+
+/*
+ * tcache_flush - Returns n cached blocks to the free lists through
+ * the slow path
+ */
+static void tcache_flush(struct tcache_bin *bin, int n)
+{
+    char *bp;
+
+    while (n-- > 0 && bin->head != 0) {
+        bp = (char *)COMP_ADDRESS(bin->head);
+        bin->head = *(mm_off_t *)bp;
+        bin->count--;
+        free_slow(bp);
+    }
+}
+#endif /* def MM_TCACHE */
+
+#ifdef MM_BITMAP
+/*
+ * bm_lookup - Binary search of the address-sorted run table for the
+ * run containing bp. Returns its bm_index position, or -1 when bp is
+ * an ordinary block
+ */
+static int bm_lookup(void *bp)
+{
+    int lo = 0, hi = bm_nruns - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        struct bm_run *r = &bm_runs[bm_index[mid]];
+
+        if ((char *)bp < r->base)
+            hi = mid - 1;
+        else if ((char *)bp >= r->base + r->total - WSIZE)
+            lo = mid + 1;
+        else
+            return mid;
+    }
+    return -1;
+}
+
+/*
+ * bm_run_new - Carves a fresh run for class c through the normal
+ * find_fit/place path (growing the heap like malloc would), writes a
+ * real allocated header into every slot, and registers the run in
+ * the address table and its class's partial list. Returns the run id
+ * or -1 when the table is full or the heap cannot grow
+ */
+static int bm_run_new(int c)
+{
+    size_t asize = BM_MINSIZE + (size_t)c * DSIZE;
+    size_t total = (size_t)BM_SLOTS * asize;
+    struct bm_run *r;
+    char *bp;
+    int id, pos, i;
+
+    if (bm_free_id >= 0) {
+        id = bm_free_id;
+        bm_free_id = bm_runs[id].next;
+    }
+    else if (bm_used < MM_MAXRUNS)
+        id = bm_used++;
+    else
+        return -1;
+
+    bp = find_fit(total);
+    if (bp == NULL && quarantine_head != 0) {
+        quarantine_drain();
+        bp = find_fit(total);
+    }
+    if (bp == NULL) {
+        size_t extendsize = MAX(total, chunk_cur);
+
+        if ((bp = extend_heap(extendsize/WSIZE)) == NULL) {
+            bm_runs[id].next = bm_free_id;
+            bm_free_id = id;
+            return -1;
+        }
+        if (chunk_cur < mm_cfg.chunk_max)
+            chunk_cur = MAX(chunk_cur * 2, mm_cfg.chunk_min);
+    }
+    place(bp, total);
+    fresh_consume(bp, total);
+    total = GET_SIZE(HDRP(bp)); /* place may keep a sub-minimum remainder */
+
+    r = &bm_runs[id];
+    r->base = bp;
+    r->bits = ~0UL;
+    r->asize = (unsigned int)asize;
+    r->total = (unsigned int)total;
+
+    /* Every slot gets a real header so frees, heap walks and the
+     * prev-alloc protocol see ordinary allocated blocks; the last
+     * slot absorbs whatever place left beyond an even split */
+    PUT(HDRP(bp), PACK(asize, ALLOCBITS) | GET_PREV_ALLOC(HDRP(bp)));
+    for (i = 1; i < BM_SLOTS; i++) {
+        size_t ssz = i == BM_SLOTS - 1
+                   ? total - (size_t)(BM_SLOTS - 1) * asize : asize;
+
+        PUT(HDRP(bp + (size_t)i * asize), PACK(ssz, ALLOCBITS) | 0x2);
+    }
+
+    for (pos = bm_nruns; pos > 0 && bm_runs[bm_index[pos-1]].base > bp;
+         pos--)
+        bm_index[pos] = bm_index[pos-1];
+    bm_index[pos] = (short)id;
+    bm_nruns++;
+
+    r->prev = -1;
+    r->next = bm_partial[c];
+    if (r->next >= 0)
+        bm_runs[r->next].prev = id;
+    bm_partial[c] = id;
+    return id;
+}
+
+/*
+ * bm_run_retire - Rewrites an all-free run as the single block it
+ * was carved from and hands it back to the class lists
+ */
+static void bm_run_retire(int pos)
+{
+    int id = bm_index[pos];
+    struct bm_run *r = &bm_runs[id];
+    int c = BM_CLASS(r->asize);
+
+    if (r->prev >= 0)
+        bm_runs[r->prev].next = r->next;
+    else
+        bm_partial[c] = r->next;
+    if (r->next >= 0)
+        bm_runs[r->next].prev = r->prev;
+
+    memmove(&bm_index[pos], &bm_index[pos+1],
+            (bm_nruns - pos - 1) * sizeof(bm_index[0]));
+    bm_nruns--;
+
+    PUT(HDRP(r->base), PACK(r->total, ALLOCBITS) |
+        GET_PREV_ALLOC(HDRP(r->base)));
+    free_slow(r->base);
+
+    r->next = bm_free_id;
+    bm_free_id = id;
+}
+
+/*
+ * bm_malloc - Pops a free slot from the head of the class's partial
+ * list: one find-first-set, one bit clear. NULL sends the caller to
+ * the ordinary list path
+ */
+static void *bm_malloc(size_t asize)
+{
+    int c = BM_CLASS(asize);
+    int id = bm_partial[c];
+    struct bm_run *r;
+    int i;
+
+    if (id < 0 && (id = bm_run_new(c)) < 0)
+        return NULL;
+    r = &bm_runs[id];
+    i = __builtin_ctzl(r->bits);
+    r->bits &= r->bits - 1;
+    if (r->bits == 0) {
+        /* Full runs leave the partial list; a free relinks them */
+        bm_partial[c] = r->next;
+        if (r->next >= 0)
+            bm_runs[r->next].prev = -1;
+    }
+    return r->base + (size_t)i * r->asize;
+}
+
+/*
+ * bm_free - Returns a slot to its run's bitmap; 0 when bp is not in
+ * any run and belongs to the ordinary free path. Follows
+ * mm_checkheap's convention on corruption: print and exit
+ */
+static int bm_free(void *bp)
+{
+    int pos = bm_lookup(bp);
+    struct bm_run *r;
+    int i, was_full;
+
+    if (pos < 0)
+        return 0;
+    r = &bm_runs[bm_index[pos]];
+    i = (int)(((char *)bp - r->base) / r->asize);
+    if (r->base + (size_t)i * r->asize != (char *)bp) {
+        printf("Bitmap run: %p is not a slot start\n", bp);
+        exit(0);
+    }
+    if (r->bits & (1UL << i)) {
+        printf("Bitmap run: double free of %p\n", bp);
+        exit(0);
+    }
+    was_full = r->bits == 0;
+    r->bits |= 1UL << i;
+    if (was_full) {
+        int c = BM_CLASS(r->asize);
+        int id = bm_index[pos];
+
+        r->prev = -1;
+        r->next = bm_partial[c];
+        if (r->next >= 0)
+            bm_runs[r->next].prev = id;
+        bm_partial[c] = id;
+    }
+    /* An empty run goes back to the lists only while the class has
+     * another partial run; the last one stays so a malloc/free
+     * ping-pong does not carve and retire a run per cycle */
+    if (r->bits == ~0UL && (r->prev >= 0 || r->next >= 0))
+        bm_run_retire(pos);
+    return 1;
+}
+#endif /* def MM_BITMAP */
+
+/*
+ *  * coalesce - Boundary tag coalescing. Unlinks any free neighbors from
+ *   * their class lists, merges, and inserts the result into the class
+ *    * matching its final size. Return ptr to coalesced block
+ *     */
+static void *coalesce(void *bp)
+{
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (prev_alloc && next_alloc) {            /* Case 1 */
+    }
+
+    else if (prev_alloc && !next_alloc) {      /* Case 2 */
+        freelist_remove(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp)));
+        PUT(FTRP(bp), PACK(size,0));
+    }
+
+    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+        freelist_remove(PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0) | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp))));
+        PUT(FTRP(bp), PACK(size, 0));
+        bp = PREV_BLKP(bp);
+    }
+
+    else {                                     /* Case 4 */
+        freelist_remove(NEXT_BLKP(bp));
+        freelist_remove(PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+            GET_SIZE(FTRP(NEXT_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0) | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp))));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+        bp = PREV_BLKP(bp);
+    }
+    freelist_add(bp);
+    return bp;
+}
+
+/*
+ * growth_decay - Called when a free merges into an extension-sized
+ * block: the heap has slack again, so back off the adaptive growth
+ * step. Not called from extend_heap's own coalesce, which would
+ * cancel the doubling
+ */
+static void growth_decay(void *bp)
+{
+    if (GET_SIZE(HDRP(bp)) >= chunk_cur && chunk_cur > mm_cfg.chunk_min)
+        chunk_cur >>= 1;
+}
+
+/*
+ * adjust_size - Rounds a request up to a legal block size: header
+ * overhead plus alignment, with MINBLKSIZE as the floor (a free block
+ * needs room for its link words and footer)
+ */
+static size_t adjust_size(size_t size)
+{
+    if (size <= MINBLKSIZE - WSIZE)
+        return MINBLKSIZE;
+    return DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE);
+}
+
+/*
+ *  * realloc - Resize in place when the block or its free successor
+ *   * allows it, falling back to malloc/copy/free only when not
+ *    */
+void *realloc(void *ptr, size_t size)
+{
+    void *newptr;
+
+    /* If size == 0 then this is just free, and we return NULL. */
+    if(size == 0) {
+        free(ptr);
+        return 0;
+    }
+
+    /* If oldptr is NULL, then this is just malloc. */
+    if(ptr == NULL) {
+        return malloc(size);
+    }
+
+    /* The same cap malloc enforces, so adjust_size below cannot wrap;
+     * the old block stays valid, as a failed realloc requires */
+    if (size > ((size_t)-1 >> 1))
+        return NULL;
+
+    /* A tagged block keeps its charge across the resize, at the new
+     * capacity and address; on failure the old charge is restored */
+    unsigned int tag = tag_nlive != 0 ? tag_remove(ptr) : 0;
+
+    TRACE_SUSPEND();
+    newptr = realloc_impl(ptr, size);
+    TRACE_RESUME();
+    TRACE_EVENT(MM_TR_REALLOC, size, ptr, newptr);
+    if (tag != 0)
+        tag_insert(newptr != NULL ? newptr : ptr, tag);
+    return newptr;
+}
+
+/*
+ * realloc_impl - The resize itself, with the delegation cases peeled
+ * off in the wrapper so a traced build records one op per call
+ */
+static void *realloc_impl(void *ptr, size_t size)
+{
+    size_t oldsize, asize, extra;
+    void *newptr;
+
+#ifdef MM_HARDEN
+    harden_check(ptr);   /* Same validation free gets */
+#endif
+
+    /* Over-growth: with realloc_grow set, an expanding buffer gets
+     * realloc_grow percent of capacity slack on top of the request,
+     * so geometric growth costs O(log n) allocator visits instead of
+     * one per append. size/100*grow rather than size*grow/100: the
+     * request may be near SIZE_MAX */
+    extra = mm_cfg.realloc_grow > 0
+          ? size / 100 * (size_t)mm_cfg.realloc_grow : 0;
+
+    /* Directly-mapped blocks resize against their own mapping: shrink
+     * is free, growth is a fresh allocation and a copy */
+    if (IS_MAPPED(HDRP(ptr))) {
+        struct map_prefix *mp = (struct map_prefix *)ptr - 1;
+        size_t plen = mp->len - sizeof(struct map_prefix);
+
+        if (size <= plen)
+            return ptr;
+        newptr = malloc(size);
+        if (!newptr)
+            return 0;
+        mm_copy(newptr, ptr, plen);
+        st_nfree++;
+        map_free(ptr);
+        return newptr;
+    }
+
+    asize = adjust_size(size);
+    oldsize = GET_SIZE(HDRP(ptr));
+
+#ifdef MM_BITMAP
+    /* Run slots have fixed geometry: never split a shrink tail into
+     * the run or absorb a neighboring slot. In place while the
+     * request still fits, otherwise allocate-copy-free */
+    if (oldsize >= BM_MINSIZE && oldsize < BM_MAXSIZE + MINBLKSIZE &&
+        bm_lookup(ptr) >= 0) {
+        if (asize <= oldsize)
+            return ptr;
+        goto move;
+    }
+#endif
+
+#ifdef MM_ARENAS
+    struct arena *home = block_arena(ptr);
+
+    cur_arena = home;
+    pthread_mutex_lock(&home->lock);
+#endif
+
+    /* Shrink in place: split off the tail when it can stand alone as
+     * a free block, otherwise just keep the slack. Under the growth
+     * factor the split also waits until the request falls below half
+     * the block (hysteresis), so a buffer oscillating around its
+     * capacity does not split and remerge its slack on every call */
+    if (asize <= oldsize) {
+        if (oldsize - asize >= MINBLKSIZE &&
+            (mm_cfg.realloc_grow == 0 || asize * 2 < oldsize)) {
+            void *tail;
+
+            PUT(HDRP(ptr), PACK(asize, ALLOCBITS) | GET_PREV_ALLOC(HDRP(ptr)));
+            tail = NEXT_BLKP(ptr);
+            PUT(HDRP(tail), PACK(oldsize-asize, 0) | 0x2);
+            PUT(FTRP(tail), PACK(oldsize-asize, 0));
+            CLR_PREV_ALLOC(HDRP(NEXT_BLKP(tail)));
+            st_live -= oldsize - asize;
+            coalesce(tail);
+        }
+#ifdef MM_ARENAS
+        pthread_mutex_unlock(&home->lock);
+#endif
+        return ptr;
+    }
+
+    /* Grow in place: absorb the adjacent free successor. want is the
+     * block size including over-growth slack; the slack stays inside
+     * the block rather than being split down to the bare request */
+    {
+        void *next = NEXT_BLKP(ptr);
+        size_t csize;
+        size_t want = extra != 0 && size + extra > size
+                    ? adjust_size(size + extra) : asize;
+
+#if !defined(MM_ARENAS) && !defined(MM_LARGEHEAP)
+        /* Last block in the heap: extend by the missing amount and
+         * fall through to absorb the extension. Fenced builds skip
+         * this since the extension would not be adjacent */
+        if (GET_SIZE(HDRP(next)) == 0 && GET_ALLOC(HDRP(next))) {
+            if (extend_heap(MAX(want - oldsize, CHUNKSIZE)/WSIZE) != NULL)
+                next = NEXT_BLKP(ptr);
+        }
+#endif
+        if (!GET_ALLOC(HDRP(next)) &&
+            (csize = oldsize + GET_SIZE(HDRP(next))) >= asize) {
+            freelist_remove(next);
+            if (csize >= want && csize - want >= MINBLKSIZE) {
+                void *tail;
+
+                PUT(HDRP(ptr), PACK(want, ALLOCBITS) | GET_PREV_ALLOC(HDRP(ptr)));
+                tail = NEXT_BLKP(ptr);
+                PUT(HDRP(tail), PACK(csize-want, 0) | 0x2);
+                PUT(FTRP(tail), PACK(csize-want, 0));
+                freelist_add(tail);
+            }
+            else {
+                PUT(HDRP(ptr), PACK(csize, ALLOCBITS) | GET_PREV_ALLOC(HDRP(ptr)));
+                SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+            }
+#ifndef MM_ARENAS
+            /* The absorbed successor may have been the known-zero
+             * span; it is user payload now */
+            fresh_consume(ptr, GET_SIZE(HDRP(ptr)));
+#endif
+            st_live += GET_SIZE(HDRP(ptr)) - oldsize;
+            if (st_live > st_peak_live)
+                st_peak_live = st_live;
+#ifdef MM_ARENAS
+            pthread_mutex_unlock(&home->lock);
+#endif
+            return ptr;
+        }
+    }
+#ifdef MM_ARENAS
+    pthread_mutex_unlock(&home->lock);
+#endif
+
+#ifdef MM_BITMAP
+move:
+#endif
+    /* Neighbors can't help: allocate (with growth slack), copy, free */
+    newptr = NULL;
+    if (extra != 0 && size + extra > size)
+        newptr = malloc(size + extra);
+    if (newptr == NULL)
+        newptr = malloc(size);
+
+    /* If realloc() fails the original block is left untouched  */
+    if(!newptr) {
+        return 0;
+    }
+
+    /* Copy the old data. */
+    oldsize = GET_SIZE(HDRP(ptr)) - WSIZE; /* Payload bytes: size less header */
+    if(size < oldsize) oldsize = size;
+    mm_copy(newptr, ptr, oldsize);
+
+    /* Free the old block. */
+    free(ptr);
+
+    return newptr;
+}
+
+/*
+ * mm_usable_size - Bytes the block can actually hold, which may
+ * exceed the requested size through placement rounding or realloc
+ * growth slack. A container that appends until this capacity is
+ * reached consumes the slack without a realloc round trip
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    if (IS_MAPPED(HDRP(ptr)))
+        return ((struct map_prefix *)ptr - 1)->len
+               - sizeof(struct map_prefix);
+    return GET_SIZE(HDRP(ptr)) - WSIZE;
+}
+
+/*
+ * mm_block_node - NUMA node holding the block's first page, or -1
+ * where the kernel cannot say (no NUMA, page not yet touched)
+ */
+int mm_block_node(void *ptr)
+{
+#ifdef __linux__
+    int node = -1;
+
+    if (ptr == NULL ||
+        syscall(SYS_get_mempolicy, &node, NULL, 0, (unsigned long)ptr,
+                MPOL_F_NODE | MPOL_F_ADDR) != 0)
+        return -1;
+    return node;
+#else
+    (void)ptr;
+    return -1;
+#endif
+}
+
+/*
+ * mm_pin_node - Migrates the whole pages the block spans to node and
+ * keeps them preferred there. Page granularity: neighbors sharing the
+ * block's first or last page move with it. Returns 0 on success
+ */
+int mm_pin_node(void *ptr, int node)
+{
+#ifdef __linux__
+    unsigned long mask;
+    size_t page, len;
+    char *lo, *hi;
+
+    if (ptr == NULL || node < 0 || node >= (int)(8*sizeof(mask)))
+        return -1;
+    page = mem_pagesize();
+    lo = (char *)((size_t)ptr & ~(page-1));
+    hi = (char *)(((size_t)ptr + mm_usable_size(ptr) + page-1) & ~(page-1));
+    len = hi - lo;
+    mask = 1UL << node;
+    return syscall(SYS_mbind, lo, len, MPOL_PREFERRED, &mask,
+                   8*sizeof(mask), MPOL_MF_MOVE) == 0 ? 0 : -1;
+#else
+    (void)ptr;
+    (void)node;
+    return -1;
+#endif
+}
+
+#ifndef MM_ARENAS
+/*
+ * fresh_consume - Retires [bp, bp + asize) from the known-zero span
+ * when a block is carved out of it, and records the still-zero part
+ * of the payload in fresh_ret_* for calloc. The retired range runs
+ * two link words past the block since place writes the split
+ * remainder's header and list links there
+ */
+static void fresh_consume(void *bp, size_t asize)
+{
+    char *lo = bp;
+
+    fresh_ret_lo = MAX(fresh_lo, lo);
+    fresh_ret_hi = MIN(fresh_hi, lo + asize - WSIZE);
+    if (lo < fresh_hi && lo + asize > fresh_lo)
+        fresh_lo = MIN(fresh_hi, lo + asize + 2*LINKSIZE);
+}
+#endif
+
+/* Fills and copies above the non-temporal threshold bypass the cache
+ * with streaming stores: a block that big cannot fit in the LLC, so
+ * caching the stores would only evict the caller's working set */
+#define MM_NT_THRESHOLD ((size_t)1 << 20)
+
+/*
+ * mm_fill0 - Zero-fill kernel for calloc. Payloads are 8-aligned, so
+ * after a short scalar head the bulk of the fill runs as aligned
+ * vector stores; len may be ragged (calloc fills request bytes, not
+ * block sizes) and the tail is scalar again. Plain memset where no
+ * vector ISA is compiled in
+ */
+static void mm_fill0(void *dst, size_t len)
+{
+#if defined(__AVX2__)
+    char *d = dst;
+    char *end = d + len;
+    size_t head = (0 - (size_t)d) & 31;
+    __m256i z = _mm256_setzero_si256();
+
+    if (len < 64) {
+        memset(dst, 0, len);
+        return;
+    }
+    memset(d, 0, head);
+    d += head;
+    if (len >= MM_NT_THRESHOLD) {
+        for (; d + 32 <= end; d += 32)
+            _mm256_stream_si256((__m256i *)d, z);
+        _mm_sfence();
+    }
+    else
+        for (; d + 32 <= end; d += 32)
+            _mm256_store_si256((__m256i *)d, z);
+    memset(d, 0, end - d);
+#elif defined(__SSE2__)
+    char *d = dst;
+    char *end = d + len;
+    size_t head = (0 - (size_t)d) & 15;
+    __m128i z = _mm_setzero_si128();
+
+    if (len < 64) {
+        memset(dst, 0, len);
+        return;
+    }
+    memset(d, 0, head);
+    d += head;
+    if (len >= MM_NT_THRESHOLD) {
+        for (; d + 16 <= end; d += 16)
+            _mm_stream_si128((__m128i *)d, z);
+        _mm_sfence();
+    }
+    else
+        for (; d + 16 <= end; d += 16)
+            _mm_store_si128((__m128i *)d, z);
+    memset(d, 0, end - d);
+#else
+    memset(dst, 0, len);
+#endif
+}
+
+/*
+ * mm_copy - Forward copy kernel for realloc. dst is a fresh payload
+ * and never overlaps src (realloc only copies after giving up on
+ * resizing in place). dst is 8-aligned; src may sit at any offset
+ * relative to it, so loads are unaligned and stores aligned
+ */
+static void mm_copy(void *dst, const void *src, size_t len)
+{
+#if defined(__AVX2__)
+    char *d = dst;
+    const char *s = src;
+    char *end = d + len;
+    size_t head = (0 - (size_t)d) & 31;
+
+    if (len < 64) {
+        memcpy(dst, src, len);
+        return;
+    }
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    if (len >= MM_NT_THRESHOLD) {
+        for (; d + 32 <= end; d += 32, s += 32)
+            _mm256_stream_si256((__m256i *)d,
+                                _mm256_loadu_si256((const __m256i *)s));
+        _mm_sfence();
+    }
+    else
+        for (; d + 32 <= end; d += 32, s += 32)
+            _mm256_store_si256((__m256i *)d,
+                               _mm256_loadu_si256((const __m256i *)s));
+    memcpy(d, s, end - d);
+#elif defined(__SSE2__)
+    char *d = dst;
+    const char *s = src;
+    char *end = d + len;
+    size_t head = (0 - (size_t)d) & 15;
+
+    if (len < 64) {
+        memcpy(dst, src, len);
+        return;
+    }
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    if (len >= MM_NT_THRESHOLD) {
+        for (; d + 16 <= end; d += 16, s += 16)
+            _mm_stream_si128((__m128i *)d,
+                             _mm_loadu_si128((const __m128i *)s));
+        _mm_sfence();
+    }
+    else
+        for (; d + 16 <= end; d += 16, s += 16)
+            _mm_store_si128((__m128i *)d,
+                            _mm_loadu_si128((const __m128i *)s));
+    memcpy(d, s, end - d);
+#else
+    memcpy(dst, src, len);
+#endif
+}
+
+/*
+ * calloc - Allocate the block and set it to zero. Payload still
+ * inside the known-zero span of the latest heap extension has never
+ * been written, so only the dirty head and tail of the block (if
+ * any) need the memset
+ */
+void *calloc (size_t nmemb, size_t size)
+{
+  size_t bytes;
+  void *newptr;
+
+  /* The multiply overflows for pathological counts; glibc returns
+   * NULL with ENOMEM here and callers expect the same */
+  if (size != 0 && nmemb > (size_t)-1 / size)
+      return NULL;
+  bytes = nmemb * size;
+
+  TRACE_SUSPEND();
+  newptr = malloc(bytes);
+  TRACE_RESUME();
+  if (newptr == NULL)
+      goto out;
+
+  /* A fresh mapping is zero-filled by the kernel and never recycled,
+   * so there is nothing to clear */
+  if (IS_MAPPED(HDRP(newptr)))
+      goto out;
+
+#ifndef MM_ARENAS
+  {
+      char *p = newptr;
+      char *zlo = MAX(p, fresh_ret_lo);
+      char *zhi = MIN(p + bytes, fresh_ret_hi);
+
+      if (zlo < zhi) {
+          mm_fill0(p, zlo - p);
+          mm_fill0(zhi, p + bytes - zhi);
+          goto out;
+      }
+  }
+#endif
+  mm_fill0(newptr, bytes);
+
+out:
+  TRACE_EVENT(MM_TR_CALLOC, bytes, NULL, newptr);
+  return newptr;
+}
+
+/*
+ * mm_malloc_batch - Allocates n blocks of the same size in one pass.
+ * One free block big enough for the whole batch is carved into n
+ * chunks with a single list removal and one header write per chunk,
+ * instead of n find_fit/place round trips. Bypasses the thread cache.
+ * Returns the number of blocks delivered into out; less than n only
+ * when the heap cannot grow any further
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t asize, filled, extendsize;
+    char *bp, *cp;
+
+    if (size == 0 || n == 0)
+        return 0;
+    if (size > ((size_t)-1 >> 1))   /* Same cap as malloc */
+        return 0;
+    asize = adjust_size(size);
+    if (n > (size_t)-1 / asize)   /* Batch byte total must not overflow */
+        return 0;
+
+#ifdef MM_ARENAS
+    lazy_init();
+    cur_arena = arena_get();
+    pthread_mutex_lock(&cur_arena->lock);
+    arena_drain(cur_arena);
+#else
+    if (heap_listp == 0){
+        mm_init();
+    }
+#endif
+
+    filled = 0;
+    while (filled < n) {
+        size_t want = (n - filled) * asize;
+        size_t csize, rem, k, i;
+
+        /* Prefer one block that covers the rest of the batch; settle
+         * for whatever single-chunk fit exists */
+        if ((bp = find_fit(want)) == NULL)
+            bp = find_fit(asize);
+#ifndef MM_ARENAS
+        if (bp == NULL && quarantine_head != 0) {
+            quarantine_drain();
+            if ((bp = find_fit(want)) == NULL)
+                bp = find_fit(asize);
+        }
+#endif
+        if (bp == NULL) {
+            extendsize = MAX(want, chunk_cur);
+            if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+                break;
+            if (chunk_cur < mm_cfg.chunk_max)
+                chunk_cur = MAX(chunk_cur * 2, mm_cfg.chunk_min);
+        }
+
+        csize = GET_SIZE(HDRP(bp));
+        k = csize / asize;
+        if (k > n - filled)
+            k = n - filled;
+        rem = csize - k * asize;
+        if (rem != 0 && rem < MINBLKSIZE) {
+            if (k > 1) {         /* Remainder too small to stand alone */
+                k--;
+                rem += asize;
+            }
+            else
+                rem = 0;         /* Lone chunk keeps the slack */
+        }
+
+        freelist_remove(bp);
+#ifndef MM_ARENAS
+        fresh_consume(bp, csize);
+#endif
+        cp = bp;
+        for (i = 0; i < k; i++) {
+            size_t csz = (i == k-1 && rem == 0) ? csize - (k-1)*asize
+                                                : asize;
+
+            PUT(HDRP(cp), PACK(csz, ALLOCBITS) |
+                (i == 0 ? GET_PREV_ALLOC(HDRP(cp)) : 0x2));
+            out[filled++] = cp;
+            st_nmalloc++;
+            st_live += csz;
+            cp += csz;
+        }
+        if (st_live > st_peak_live)
+            st_peak_live = st_live;
+        if (rem != 0) {
+            PUT(HDRP(cp), PACK(rem, 0) | 0x2);
+            PUT(FTRP(cp), PACK(rem, 0));
+            freelist_add(cp);
+        }
+        else
+            SET_PREV_ALLOC(HDRP(cp));
+    }
+
+#ifdef MM_ARENAS
+    pthread_mutex_unlock(&cur_arena->lock);
+#endif
+    return filled;
+}
+
+/*
+ * ptr_cmp - qsort comparator ordering block pointers by address
+ */
+static int ptr_cmp(const void *a, const void *b)
+{
+    const char *x = *(const char * const *)a;
+    const char *y = *(const char * const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * mm_free_batch - Frees n blocks in one sweep. The pointers are
+ * sorted by address so that physically adjacent blocks merge into a
+ * single free region with one coalesce call, instead of n independent
+ * header/footer rewrites and list churn. NULL entries are skipped
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    size_t i, j;
+
+    if (heap_listp == 0)
+        return;
+    if (tag_nlive != 0) {
+        for (i = 0; i < n; i++)
+            if (ptrs[i] != NULL)
+                tag_remove(ptrs[i]);
+    }
+    qsort(ptrs, n, sizeof(void *), ptr_cmp);
+
+    i = 0;
+    while (i < n && ptrs[i] == NULL)
+        i++;
+    while (i < n) {
+        char *start = ptrs[i];
+
+#ifdef MM_HARDEN
+        harden_check(start);
+#endif
+        if (IS_MAPPED(HDRP(start))) {
+            st_nfree++;
+            map_free(start);
+            i++;
+            continue;
+        }
+#ifdef MM_BITMAP
+        {
+            size_t bsz = GET_SIZE(HDRP(start));
+
+            /* Run slots go back to their bitmap; merging them with
+             * neighbors would tear the run apart */
+            if (bsz >= BM_MINSIZE && bsz < BM_MAXSIZE + MINBLKSIZE &&
+                bm_free(start)) {
+                st_nfree++;
+                i++;
+                continue;
+            }
+        }
+#endif
+        char *end = start + GET_SIZE(HDRP(start));
+        size_t size;
+
+        for (j = i + 1; j < n && (char *)ptrs[j] == end; j++) {
+#ifdef MM_BITMAP
+            /* A run slot must not be swallowed by the merge; it gets
+             * its own iteration and goes back to its bitmap */
+            if (bm_lookup(ptrs[j]) >= 0)
+                break;
+#endif
+            end += GET_SIZE(HDRP(ptrs[j]));
+        }
+        size = end - start;
 
+#ifdef MM_ARENAS
+        struct arena *home = block_arena(start);
 
+        cur_arena = home;
+        pthread_mutex_lock(&home->lock);
+#endif
+        st_nfree += j - i;
+        st_live -= size;
+        PUT(HDRP(start), PACK(size, 0) | GET_PREV_ALLOC(HDRP(start)));
+        PUT(FTRP(start), PACK(size, 0));
+        CLR_PREV_ALLOC(HDRP(NEXT_BLKP(start)));
+        growth_decay(coalesce(start));
+#ifdef MM_ARENAS
+        pthread_mutex_unlock(&home->lock);
+#endif
+        i = j;
+    }
+    if (mm_cfg.trim_threshold != 0)
+        trim_maybe();
+}
 
-/* 
- *  * free - Free a block 
- *   */
-void free(void *bp)
+/*
+ * prof_cycles - Cheap timestamp for sampled latency measurements;
+ * rdtsc where we have it, zero elsewhere so the samples still carry
+ * size and outcome
+ */
+static unsigned long prof_cycles(void)
 {
-    if(bp == 0) 
-        return;
-
-    size_t size = GET_SIZE(HDRP(bp));
-    if (heap_listp == 0){
-        mm_init();
-    }
+#ifdef __x86_64__
+    unsigned int lo, hi;
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long)hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
 
-    freelist_add(bp);
-    coalesce(bp);
-    ;
+/*
+ * prof_record - Writes one sample into the ring, overwriting the
+ * oldest once it is full
+ */
+static void prof_record(int op, size_t size, unsigned long cycles,
+                        int outcome)
+{
+    struct mm_sample *s = &prof_ring[prof_head];
+
+    s->size = size;
+    s->cycles = cycles;
+    s->op = (unsigned char)op;
+    s->outcome = (unsigned char)outcome;
+    prof_head = (prof_head + 1) % MM_PROF_RING;
+    if (prof_count < MM_PROF_RING)
+        prof_count++;
+    st_nsample++;
 }
 
 /*
- * are_adjacent - Handles the case of the two blocks being coalesced
- * being next to each other in the list
- */ 
-static void are_adjacent(void *bp, int case3)
+ * mm_set_sample_rate - Samples every rate-th malloc/free into the
+ * ring; 0 turns sampling off. The aggregate counters stay live either
+ * way
+ */
+void mm_set_sample_rate(unsigned int rate)
 {
-    if(case3){
-        void *next = (void *)GET_SUCC(bp);
-        SET_PRED(next, heap_listp);
-        first_free = next;
-    }
-    else{
-        void *new_succ = (void *)GET_SUCC(GET_SUCC(bp));
-        SET_SUCC(bp, new_succ);
-        if (new_succ != heap_listp)
-            SET_PRED(new_succ, bp);
-    }
+    prof_rate = rate;
+    prof_left = rate;
 }
 
 /*
- * not_adjacent - Handles the case of the two blocks being coalesced
- * not being next to each other in the list
- */ 
-static void not_adjacent(void *bp, int case3)
+ * mm_prof_read - Drains up to max samples, oldest first, into out.
+ * Returns the number copied
+ */
+size_t mm_prof_read(struct mm_sample *out, size_t max)
 {
-    if(case3){
-        void* prev = PREV_BLKP(bp);
-        
-        SET_SUCC((void *)GET_PRED(prev), GET_SUCC(prev));
-        if ((char *)GET_SUCC(prev) != heap_listp)
-            SET_PRED((void *)GET_SUCC(prev), GET_PRED(prev));
-        SET_PRED(prev, heap_listp);
-        SET_SUCC(prev, GET_SUCC(bp));
-        first_free = prev;
-        SET_PRED((void *)GET_SUCC(bp), first_free);
-    }
-    else{
-        void *next = NEXT_BLKP(bp);
-        void *pred = (void *)GET_PRED(next);
-        void *succ = (void *)GET_SUCC(next);
+    size_t n = prof_count < max ? prof_count : max;
+    size_t i, first = (prof_head + MM_PROF_RING - prof_count) % MM_PROF_RING;
 
-        SET_SUCC(pred, succ);
-        if (succ != heap_listp)
-            SET_PRED(succ, pred);
-    }
+    for (i = 0; i < n; i++)
+        out[i] = prof_ring[(first + i) % MM_PROF_RING];
+    prof_count = 0;
+    return n;
 }
 
 /*
- *  * coalesce - Boundary tag coalescing. Return ptr to coalesced block
- *   */
-static void *coalesce(void *bp) 
+ * mm_stats_snapshot - Fills out with the allocator's aggregate
+ * counters. Everything but largest_free comes from counters the hot
+ * path already maintains; largest_free walks the (sorted) class lists
+ * since only a snapshot ever needs it. Under MM_ARENAS the figures
+ * are collected without locks and are approximate
+ */
+void mm_stats_snapshot(struct mm_stats *out)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
-
-    if (prev_alloc && next_alloc) {            /* Case 1 */
-        return bp;
-    }
+    int c;
+
+    out->heap_bytes = heap_listp == 0 ? 0 : heap_size();
+    out->peak_heap = st_peak_heap;
+    out->live_bytes = st_live;
+    out->peak_live = st_peak_live;
+    out->free_bytes = st_free_bytes;
+    out->free_blocks = st_free_blocks;
+    out->nmalloc = st_nmalloc;
+    out->nfree = st_nfree;
+    out->nextend = st_nextend;
+    out->nsample = st_nsample;
+    out->mapped_bytes = st_mapped;
+    out->nmmap = st_nmmap;
+
+    out->largest_free = 0;
+    if (heap_listp == 0)
+        return;
+    for (c = 0; c < SEG_NCLASSES; c++) {
+#ifdef MM_ARENAS
+        int a;
 
-    else if (prev_alloc && !next_alloc) {      /* Case 2 */
-        if ((void *)GET_SUCC(bp) == NEXT_BLKP(bp))
-            are_adjacent(bp, 0);
-        else 
-            not_adjacent(bp, 0);
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size,0));
-    }
+        for (a = 0; a < MM_NARENAS; a++) {
+            char *fp;
 
-    else if (!prev_alloc && next_alloc) {      /* Case 3 */
-        if ((void *)GET_SUCC(bp) == PREV_BLKP(bp))
-            are_adjacent(bp, 1);
-        else 
-            not_adjacent(bp, 1);
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
-    }
+            for (fp = arenas[a].seg_free[c]; fp != heap_listp;
+                 fp = (char *)GET_SUCC(fp))
+                if (GET_SIZE(HDRP(fp)) > out->largest_free)
+                    out->largest_free = GET_SIZE(HDRP(fp));
+        }
+#else
+        char *fp;
 
-    else {                                     /* Case 4 */
-        if ((void *)GET_SUCC(bp) == NEXT_BLKP(bp))
-            are_adjacent(bp, 0);
-        else 
-            not_adjacent(bp, 0);
-        if ((void *)GET_SUCC(bp) == PREV_BLKP(bp))
-            are_adjacent(bp, 1);
-        else 
-            not_adjacent(bp, 1);
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
-            GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
+        for (fp = seg_free[c]; fp != heap_listp; fp = (char *)GET_SUCC(fp))
+            if (GET_SIZE(HDRP(fp)) > out->largest_free)
+                out->largest_free = GET_SIZE(HDRP(fp));
+#endif
     }
-    return bp;
 }
 
+/* Records buffered per writer call while snapshotting */
+#define SNAP_BATCH 64
+
 /*
- *  * realloc - Naive implementation of realloc
- *   */
-void *realloc(void *ptr, size_t size)
+ * mm_snapshot - Streams a binary dump of every block (format in
+ * mm_ext.h) through the caller's writer. One counting pass sizes the
+ * header, then the emitting pass batches SNAP_BATCH records per
+ * writer call so an fd writer pays one write(2) per few KB, not per
+ * block. Reads the same headers mm_checkheap does and takes no locks
+ */
+int mm_snapshot(mm_snap_writer writer, void *ctx)
 {
-    size_t oldsize;
-    void *newptr;
+    struct mm_snap_hdr hdr;
+    struct mm_snap_rec recs[SNAP_BATCH];
+    size_t nrec = 0;
+    int nbuf = 0;
+    char *bp;
 
-    /* If size == 0 then this is just free, and we return NULL. */
-    if(size == 0) {
-        free(ptr);
-        return 0;
-    }
+    if (heap_listp == 0 || writer == NULL)
+        return -1;
 
-    /* If oldptr is NULL, then this is just malloc. */
-    if(ptr == NULL) {
-        return malloc(size);
+    for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0;
+         bp = NEXT_BLKP(bp))
+        nrec++;
+
+    memcpy(hdr.magic, MM_SNAP_MAGIC, 4);
+    hdr.version = MM_SNAP_VERSION;
+    hdr.flags = 0;
+#ifdef MM_LARGEHEAP
+    hdr.flags |= MM_SNAPF_LARGEHEAP;
+#endif
+#ifdef MM_ARENAS
+    hdr.flags |= MM_SNAPF_ARENAS;
+#endif
+    hdr.heap_bytes = heap_size();
+    hdr.nrecords = nrec;
+    if (writer(ctx, &hdr, sizeof(hdr)) != 0)
+        return -1;
+
+    for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0;
+         bp = NEXT_BLKP(bp)) {
+        struct mm_snap_rec *r = &recs[nbuf++];
+
+        r->off = COMP_OFFSET(bp);
+        r->size = GET_SIZE(HDRP(bp));
+        r->bits = (unsigned int)(GET(HDRP(bp)) & 0x3);
+        if (GET_ALLOC(HDRP(bp))) {
+            r->pred = r->succ = 0;
+            r->klass = 0;
+        }
+        else {
+            r->pred = COMP_OFFSET(GET_PRED(bp));
+            r->succ = COMP_OFFSET(GET_SUCC(bp));
+            r->klass = (unsigned int)seg_index(r->size);
+        }
+        if (nbuf == SNAP_BATCH) {
+            if (writer(ctx, recs, sizeof(recs)) != 0)
+                return -1;
+            nbuf = 0;
+        }
     }
+    if (nbuf > 0 && writer(ctx, recs, nbuf * sizeof(recs[0])) != 0)
+        return -1;
+    return 0;
+}
 
-    newptr = malloc(size);
+static int snap_fd_writer(void *ctx, const void *buf, size_t len)
+{
+    int fd = *(int *)ctx;
+    const char *p = buf;
 
-    /* If realloc() fails the original block is left untouched  */
-    if(!newptr) {
-        return 0;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
     }
+    return 0;
+}
 
-    /* Copy the old data. */
-    oldsize = GET_SIZE(HDRP(ptr));
-    if(size < oldsize) oldsize = size;
-    memcpy(newptr, ptr, oldsize);
+struct snap_buf {
+    char *p;
+    size_t cap;
+    size_t used;
+};
 
-    /* Free the old block. */
-    free(ptr);
+static int snap_buf_writer(void *ctx, const void *buf, size_t len)
+{
+    struct snap_buf *sb = ctx;
 
-    return newptr;
+    if (len > sb->cap - sb->used)
+        return -1;
+    memcpy(sb->p + sb->used, buf, len);
+    sb->used += len;
+    return 0;
 }
 
 /*
- * calloc - Allocate the block and set it to zero.
+ * mm_snapshot_fd - Streams the snapshot to a file descriptor
  */
-void *calloc (size_t nmemb, size_t size)
+int mm_snapshot_fd(int fd)
 {
-  size_t bytes = nmemb * size;
-  void *newptr;
+    return mm_snapshot(snap_fd_writer, &fd);
+}
 
-  newptr = malloc(bytes);
-  memset(newptr, 0, bytes);
+/*
+ * mm_snapshot_buf - Writes the snapshot into a caller buffer; fails
+ * if cap is too small, reporting progress through used
+ */
+int mm_snapshot_buf(void *buf, size_t cap, size_t *used)
+{
+    struct snap_buf sb = { buf, cap, 0 };
+    int rc = mm_snapshot(snap_buf_writer, &sb);
 
-  return newptr;
+    if (used != NULL)
+        *used = sb.used;
+    return rc;
 }
 
-/* 
- *  * The remaining routines are internal helper routines 
+/*
+ * mm_set_list_policy - Selects how freelist_add inserts free blocks.
+ * Takes effect for blocks freed from now on; already-listed blocks
+ * keep their position
+ */
+void mm_set_list_policy(int policy)
+{
+    list_policy = policy;
+}
+
+/*
+ *  * The remaining routines are internal helper routines
  *   */
 
 /* 
  *  * extend_heap - Extend heap with free block and return its block pointer
  *   */
-static void *extend_heap(size_t words) 
+static void *extend_heap(size_t words)
 {
     char *bp;
     size_t size;
 
     /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
-    if ((long)(bp = mem_sbrk(size)) == -1)  
-        return NULL;                                        
-
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* Free block header */   
-    PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */  
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
-    
-
-    /* Add extension of heap to the free list */
-    freelist_add(bp);
-
-    /* Coalesce if the previous block was free */
-    return coalesce(bp);                                          
+    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+    if (size > ((size_t)1 << 30))  /* heap_sbrk takes an int */
+        return NULL;
+#ifdef MM_ARENAS
+    {
+        char *mem;
+
+        pthread_mutex_lock(&heap_lock);
+        if (nregions == MM_MAXREGIONS) {
+            pthread_mutex_unlock(&heap_lock);
+            return NULL;
+        }
+        if ((long)(mem = heap_sbrk(size + DSIZE)) == -1) {
+            pthread_mutex_unlock(&heap_lock);
+            return NULL;
+        }
+        st_nextend++;
+        if (heap_size() > st_peak_heap)
+            st_peak_heap = heap_size();
+        st_overhead += DSIZE;
+        /* Rewrite the old epilogue into a fence pair so coalesce can
+         * never cross into a region owned by another arena */
+        PUT(HDRP(mem), PACK(DSIZE, 1) | GET_PREV_ALLOC(HDRP(mem)));
+        PUT(mem, PACK(DSIZE, 1));
+        bp = mem + DSIZE;
+        regions[nregions].lo = bp;
+        regions[nregions].hi = bp + size;
+        regions[nregions].arena = (int)(cur_arena - arenas);
+        nregions++;
+#if defined(MM_NUMA) && defined(__linux__)
+        /* An arena that fell back to round-robin assignment claims
+         * the node it first grows from; the explicit preference keeps
+         * the region's pages together even if this thread migrates */
+        if (cur_arena->node == -1)
+            __sync_bool_compare_and_swap(&cur_arena->node, -1,
+                                         numa_current_node());
+        numa_bind_span(bp, size, cur_arena->node);
+#endif
+        PUT(HDRP(bp), PACK(size, 0) | 0x2);   /* Free block header, fence before it */
+        PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+        pthread_mutex_unlock(&heap_lock);
+        return coalesce(bp);
+    }
+#endif
+#ifdef MM_LARGEHEAP
+    {
+        char *mem;
+
+        /* Fence each extension so coalescing can never build a block
+         * bigger than one extension: the header size field is still
+         * only 4 bytes even though the heap itself may pass 4 GB */
+        if ((long)(mem = heap_sbrk(size + DSIZE)) == -1)
+            return NULL;
+        st_nextend++;
+#ifndef MM_ARENAS
+        /* Address of the historical break high-water mark: bytes
+         * below it were handed out before (mm_trim may have recycled
+         * them) and are not known zero */
+        char *hiwater = (char *)heap_hi() + 1 - heap_size() + st_peak_heap;
+#endif
+        if (heap_size() > st_peak_heap)
+            st_peak_heap = heap_size();
+        st_overhead += DSIZE;
+        PUT(HDRP(mem), PACK(DSIZE, 1) | GET_PREV_ALLOC(HDRP(mem)));
+        PUT(mem, PACK(DSIZE, 1));
+        bp = mem + DSIZE;
+        PUT(HDRP(bp), PACK(size, 0) | 0x2);   /* Free block header, fence before it */
+        PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+        {
+            void *cp = coalesce(bp);
+
+#ifndef MM_ARENAS
+            /* Sbrk memory above the high-water mark is zero except
+             * the boundary tags and the link words coalesce just
+             * wrote; remember the clean middle so calloc can skip its
+             * memset */
+            fresh_lo = MAX(bp + 2*LINKSIZE, hiwater);
+            fresh_hi = FTRP(cp);
+            if (fresh_lo >= fresh_hi)
+                fresh_lo = fresh_hi = NULL;
+#endif
+            return cp;
+        }
+    }
+#endif
+    if ((long)(bp = heap_sbrk(size)) == -1)
+        return NULL;
+    st_nextend++;
+#ifndef MM_ARENAS
+    /* Address of the historical break high-water mark: bytes below it
+     * were handed out before (mm_trim may have recycled them) and are
+     * not known zero */
+    char *hiwater = (char *)heap_hi() + 1 - heap_size() + st_peak_heap;
+#endif
+    if (heap_size() > st_peak_heap)
+        st_peak_heap = heap_size();
+
+    /* Initialize free block header/footer and the epilogue header.
+     * The old epilogue's prev-alloc bit carries over to the new
+     * block's header */
+    PUT(HDRP(bp), PACK(size, 0) | GET_PREV_ALLOC(HDRP(bp))); /* Free block header */
+    PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+
+
+    /* Coalesce if the previous block was free; coalesce also links
+     * the extension into its class list */
+    {
+        void *cp = coalesce(bp);
+
+#ifndef MM_ARENAS
+        /* Sbrk memory above the high-water mark is zero except the
+         * boundary tags and the link words coalesce just wrote;
+         * remember the clean middle so calloc can skip its memset */
+        fresh_lo = MAX(bp + 2*LINKSIZE, hiwater);
+        fresh_hi = FTRP(cp);
+        if (fresh_lo >= fresh_hi)
+            fresh_lo = fresh_hi = NULL;
+#endif
+        return cp;
+    }
 }
 
 /* 
@@ -399,43 +3445,26 @@ static void *extend_heap(size_t words)
  *    */
 static void place(void *bp, size_t asize)
 {
-    size_t csize = GET_SIZE(HDRP(bp)); 
-    void *pred = (void *)GET_PRED(bp);
-    void *succ = (void *)GET_SUCC(bp);
+    size_t csize = GET_SIZE(HDRP(bp));
 
-        if((csize - asize) >= (3*DSIZE)) {
-            PUT(HDRP(bp), PACK(asize, 1));
-            PUT(FTRP(bp), PACK(asize, 1));
-            void *new_bp = NEXT_BLKP(bp);
-            PUT(HDRP(new_bp), PACK(csize-asize, 0));
-            PUT(FTRP(new_bp), PACK(csize-asize, 0));
-            SET_PRED(new_bp, pred);
-            SET_SUCC(new_bp, succ);
-            if(pred != heap_listp)
-                SET_SUCC(pred, new_bp);
-            if(succ != heap_listp)
-                SET_PRED(succ, new_bp);
-            if(bp == first_free)
-                first_free = new_bp;
-        }
-
-        else { 
-            PUT(HDRP(bp), PACK(csize, 1));
-            PUT(FTRP(bp), PACK(csize, 1));
-            if (pred == heap_listp){
-                first_free = (char *)succ;
-                if (succ != heap_listp){
-                    SET_PRED(first_free, heap_listp);
-                }
-            }
-            else if (succ != heap_listp){
-                SET_SUCC(pred, succ);
-                SET_PRED(succ, pred);
-            }
-            else{
-                SET_SUCC(pred, succ);
-            }
-        }
+    freelist_remove(bp);
+
+    if((csize - asize) >= MINBLKSIZE) {
+        PUT(HDRP(bp), PACK(asize, ALLOCBITS) | GET_PREV_ALLOC(HDRP(bp)));
+        void *new_bp = NEXT_BLKP(bp);
+        PUT(HDRP(new_bp), PACK(csize-asize, 0) | 0x2);
+        PUT(FTRP(new_bp), PACK(csize-asize, 0));
+        freelist_add(new_bp);
+        st_live += asize;
+    }
+
+    else {
+        PUT(HDRP(bp), PACK(csize, ALLOCBITS) | GET_PREV_ALLOC(HDRP(bp)));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+        st_live += csize;
+    }
+    if (st_live > st_peak_live)
+        st_peak_live = st_live;
 }
 
 /* 
@@ -443,49 +3472,178 @@ static void place(void *bp, size_t asize)
  *   */
 static void *find_fit(size_t asize)
 {
-    /* First fit search */
-    void *bp;
-
-    for (bp = first_free; bp != heap_listp; bp = (void *)(GET_SUCC(bp))) {
-        if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp)))) {
-            return bp;
+    /* Only the request's own class can hold blocks smaller than
+     * asize, so it is the only list that needs a size test per hop.
+     * The successor is loaded and prefetched before the test so the
+     * next hop's miss overlaps this iteration's compare. Under the
+     * size-ordered policy the class is sorted ascending, so the first
+     * hit is the best fit; under LIFO this is segregated first fit */
+    void *bp, *succ;
+    int c = seg_index(asize);
+
+    if (list_policy == MM_LIST_NEXTFIT) {
+        /* Resume where the previous search stopped and wrap once, so
+         * steady-state churn does not rescan the unusable stretch at
+         * the head every call. The hit becomes the new rover; place's
+         * freelist_remove then advances it to the successor */
+        void *start = SEG_ROVER(c);
+
+        if (start == NULL)
+            start = heap_listp;
+        for (bp = start; bp != heap_listp; bp = succ) {
+            succ = (void *)(GET_SUCC(bp));
+            PREFETCH(HDRP(succ));
+            if (asize <= GET_SIZE(HDRP(bp))) {
+                SEG_ROVER(c) = bp;
+                return bp;
+            }
+        }
+        for (bp = SEG_FREE(c); bp != start && bp != heap_listp;
+             bp = succ) {
+            succ = (void *)(GET_SUCC(bp));
+            PREFETCH(HDRP(succ));
+            if (asize <= GET_SIZE(HDRP(bp))) {
+                SEG_ROVER(c) = bp;
+                return bp;
+            }
+        }
+    }
+    else {
+        for (bp = SEG_FREE(c); bp != heap_listp; bp = succ) {
+            succ = (void *)(GET_SUCC(bp));
+            PREFETCH(HDRP(succ));
+            if (asize <= GET_SIZE(HDRP(bp)))
+                return bp;
         }
     }
 
+    /* Classes partition sizes, so every block in a higher class is
+     * bigger than asize: the first nonempty head is a hit without
+     * touching the heap at all (and the smallest block in the lowest
+     * such class, keeping the sorted policy best fit) */
+    while (++c < SEG_NCLASSES)
+        if (SEG_FREE(c) != heap_listp)
+            return SEG_FREE(c);
+
     return NULL;
 }
+
+/*
+ * seg_index - Maps a block size to its segregated size class
+ */
+static int seg_index(size_t size)
+{
+    int c = 0;
+    size_t s = size >> 6;
+
+    while (s > 0 && c < SEG_NCLASSES-1) {
+        s >>= 1;
+        c++;
+    }
+    return c;
+}
+
 /*
- * freelist_add - Adds bp to the front of the free list
- * for LIFO structure
+ * freelist_add - Adds bp to its class's free list according to the
+ * insertion policy: sorted ascending by size (so a scan's first hit
+ * is the smallest sufficient block), sorted ascending by address (so
+ * first fit drifts toward low addresses and the heap compacts
+ * downward), or a LIFO push to the front
  */
 static void freelist_add(void *bp)
-{ 
+{
+    int c = seg_index(GET_SIZE(HDRP(bp)));
+
+    st_free_blocks++;
+    st_free_bytes += GET_SIZE(HDRP(bp));
+    /* Next fit inserts like LIFO: the rover, not insertion order,
+     * drives its search */
+    if (list_policy == MM_LIST_SIZE || list_policy == MM_LIST_ADDR) {
+        size_t size = GET_SIZE(HDRP(bp));
+        void *pred = heap_listp;
+        void *succ = SEG_FREE(c);
+
+        if (list_policy == MM_LIST_SIZE) {
+            while (succ != heap_listp && GET_SIZE(HDRP(succ)) < size) {
+                pred = succ;
+                succ = (void *)GET_SUCC(succ);
+                PREFETCH(HDRP(succ));
+            }
+        }
+        else {   /* MM_LIST_ADDR: sorted ascending by block address */
+            while (succ != heap_listp && succ < bp) {
+                pred = succ;
+                succ = (void *)GET_SUCC(succ);
+                PREFETCH(HDRP(succ));
+            }
+        }
+        SET_PRED(bp, pred);
+        SET_SUCC(bp, succ);
+        if (pred == heap_listp)
+            SEG_FREE(c) = bp;
+        else
+            SET_SUCC(pred, bp);
+        if (succ != heap_listp)
+            SET_PRED(succ, bp);
+        return;
+    }
 
     SET_PRED(bp, heap_listp);
-    SET_SUCC(bp, first_free);
-    if (first_free != heap_listp)
-        SET_PRED(first_free, bp);
-    first_free = bp;
+    SET_SUCC(bp, SEG_FREE(c));
+    if (SEG_FREE(c) != heap_listp)
+        SET_PRED(SEG_FREE(c), bp);
+    SEG_FREE(c) = bp;
+}
+
+/*
+ * freelist_remove - Unlinks bp from its class's free list
+ */
+static void freelist_remove(void *bp)
+{
+    void *pred = (void *)GET_PRED(bp);
+    void *succ = (void *)GET_SUCC(bp);
+    int c = seg_index(GET_SIZE(HDRP(bp)));
+
+    /* Keep the next-fit rover off the departing block, whatever the
+     * active policy, so a later policy switch finds it valid */
+    if (SEG_ROVER(c) == bp)
+        SEG_ROVER(c) = (char *)succ;
+    st_free_blocks--;
+    st_free_bytes -= GET_SIZE(HDRP(bp));
+    if (pred == heap_listp)
+        SEG_FREE(c) = (char *)succ;
+    else
+        SET_SUCC(pred, succ);
+    if (succ != heap_listp)
+        SET_PRED(succ, pred);
 }
 
 
-static void printblock(void *bp) 
+static void printblock(void *bp)
 {
     size_t hsize, halloc, fsize, falloc;
 
     hsize = GET_SIZE(HDRP(bp));
-    halloc = GET_ALLOC(HDRP(bp));  
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));  
+    halloc = GET_ALLOC(HDRP(bp));
 
     if (hsize == 0) {
         printf("%p: EOL\n", bp);
         return;
     }
 
-    printf("%p: header: [%d:%c] footer: [%c:%c]\n", bp, 
-         (unsigned int)hsize, (halloc ? 'a' : 'f'), 
-         (unsigned int)fsize, (falloc ? 'a' : 'f')); 
+    if (halloc) {
+        /* Allocated blocks have no footer */
+        printf("%p: header: [%d:a:%c]\n", bp,
+             (unsigned int)hsize, (GET_PREV_ALLOC(HDRP(bp)) ? 'a' : 'f'));
+        return;
+    }
+
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));
+
+    printf("%p: header: [%d:%c] footer: [%c:%c]\n", bp,
+         (unsigned int)hsize, (halloc ? 'a' : 'f'),
+         (unsigned int)fsize, (falloc ? 'a' : 'f'));
 }
 
 static void checkblock(void *bp) 
@@ -494,11 +3652,16 @@ static void checkblock(void *bp)
         printf("Error: %p is not doubleword aligned\n", bp);
         exit(0);
     }
-    if (GET(HDRP(bp)) != GET(FTRP(bp))){
-        printf("Error: header does not match footer\n"); 
+    if ((GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))) != 0) != (GET_ALLOC(HDRP(bp)) != 0)){
+        printf("Error: prev-alloc bit of next block does not match\n");
         exit(0);
     }
     if (!GET_ALLOC(HDRP(bp))){
+        /* Only free blocks carry a footer */
+        if ((GET(HDRP(bp)) & ~0x2) != GET(FTRP(bp))){
+            printf("Error: header does not match footer\n");
+            exit(0);
+        }
         if (!(in_freelist(bp))){
             printf("Error: free block not in free list\n");
             exit(0);
@@ -511,15 +3674,30 @@ static void checkblock(void *bp)
     }
 }
 
-/* Checks if a block is in the free list */
+/* Checks if a block is in the free list of its size class */
 int in_freelist(void *bp)
 {
     char *list_ptr;
-    for (list_ptr = first_free; list_ptr != heap_listp; list_ptr = (void *)(GET_SUCC(list_ptr))){
-        if (list_ptr == bp){            
+    int c = seg_index(GET_SIZE(HDRP(bp)));
+
+#ifdef MM_ARENAS
+    /* The heap walk crosses every arena, so look in all of them */
+    int a;
+    for (a = 0; a < MM_NARENAS; a++) {
+        for (list_ptr = arenas[a].seg_free[c]; list_ptr != heap_listp;
+             list_ptr = (void *)(GET_SUCC(list_ptr))){
+            if (list_ptr == bp){
+                return 1;
+            }
+        }
+    }
+#else
+    for (list_ptr = seg_free[c]; list_ptr != heap_listp; list_ptr = (void *)(GET_SUCC(list_ptr))){
+        if (list_ptr == bp){
             return 1;
         }
     }
+#endif
     return 0;
 }
 
@@ -552,4 +3730,148 @@ void mm_checkheap(int verbose)
         exit(0);
     }
 
+#ifdef MM_BITMAP
+    {
+        int pos, i;
+
+        /* The run table must stay address sorted and every slot must
+         * still look like the allocated block bm_run_new wrote */
+        for (pos = 0; pos < bm_nruns; pos++) {
+            struct bm_run *r = &bm_runs[bm_index[pos]];
+
+            if (pos > 0 &&
+                bm_runs[bm_index[pos-1]].base >= r->base) {
+                printf("Bitmap run table out of order at %d\n", pos);
+                exit(0);
+            }
+            for (i = 0; i < BM_SLOTS; i++) {
+                char *sp = r->base + (size_t)i * r->asize;
+                size_t want = i == BM_SLOTS - 1
+                            ? r->total - (size_t)(BM_SLOTS - 1) * r->asize
+                            : r->asize;
+
+                if (GET_SIZE(HDRP(sp)) != want || !GET_ALLOC(HDRP(sp))) {
+                    printf("Bitmap run slot %p is corrupt\n", sp);
+                    exit(0);
+                }
+            }
+        }
+    }
+#endif
+}
+
+/*
+ * mm_checkheap_quick - O(1) invariant check safe to run per request
+ * in production. Cross-checks the running counters against the heap
+ * size (every byte must be in a live block, a free block, or known
+ * overhead), and spot-reads the prologue and epilogue. Like
+ * mm_checkheap, a violation is fatal. Under MM_ARENAS the counters
+ * are unsynchronized, so quiesce the heap before calling
+ */
+void mm_checkheap_quick(void)
+{
+    char *brkp;
+
+    if (heap_listp == 0)
+        return;
+    if (GET(HDRP(heap_listp)) != PACK(DSIZE, 1) ||
+        GET(heap_listp) != PACK(DSIZE, 1)){
+        printf("Quick check: bad prologue\n");
+        exit(0);
+    }
+    brkp = (char *)heap_hi() + 1;
+    if (GET_SIZE(brkp - WSIZE) != 0 || !GET_ALLOC(brkp - WSIZE)){
+        printf("Quick check: bad epilogue\n");
+        exit(0);
+    }
+    if (st_live + st_free_bytes + st_overhead != heap_size()){
+        printf("Quick check: %zu live + %zu free + %zu overhead != %zu heap\n",
+               st_live, st_free_bytes, st_overhead, heap_size());
+        exit(0);
+    }
+    if (st_free_bytes < st_free_blocks * MINBLKSIZE){
+        printf("Quick check: %zu free blocks cannot fit in %zu free bytes\n",
+               st_free_blocks, st_free_bytes);
+        exit(0);
+    }
+}
+
+/*
+ * checkblock_fast - The O(1) subset of checkblock: everything it
+ * verifies except free-list membership, which is replaced by local
+ * link consistency (my pred's succ is me, my succ's pred is me, and
+ * if I claim to be a list head the class head agrees). Used by the
+ * windowed checker so each block costs a few loads, not a list walk
+ */
+static void checkblock_fast(void *bp)
+{
+    if ((size_t)bp % 8){
+        printf("Error: %p is not doubleword aligned\n", bp);
+        exit(0);
+    }
+    if ((GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))) != 0) != (GET_ALLOC(HDRP(bp)) != 0)){
+        printf("Error: prev-alloc bit of next block does not match\n");
+        exit(0);
+    }
+    if (!GET_ALLOC(HDRP(bp))){
+        void *pred, *succ;
+
+        if (GET_SIZE(HDRP(bp)) < MINBLKSIZE){
+            printf("Error: free block %p below minimum size\n", bp);
+            exit(0);
+        }
+        if ((GET(HDRP(bp)) & ~0x2) != GET(FTRP(bp))){
+            printf("Error: header does not match footer\n");
+            exit(0);
+        }
+        pred = (void *)GET_PRED(bp);
+        succ = (void *)GET_SUCC(bp);
+        if (succ == bp || pred == bp){
+            printf("Cycle\n");
+            exit(0);
+        }
+        if (pred != heap_listp && (void *)GET_SUCC(pred) != bp){
+            printf("Error: free block %p not linked from its pred\n", bp);
+            exit(0);
+        }
+        if (succ != heap_listp && (void *)GET_PRED(succ) != bp){
+            printf("Error: free block %p not linked from its succ\n", bp);
+            exit(0);
+        }
+        if (pred == heap_listp){
+            int c = seg_index(GET_SIZE(HDRP(bp)));
+#ifdef MM_ARENAS
+            if (block_arena(bp)->seg_free[c] != bp){
+#else
+            if (seg_free[c] != bp){
+#endif
+                printf("Error: free block %p claims to head class\n", bp);
+                exit(0);
+            }
+        }
+    }
+}
+
+/*
+ * mm_checkheap_region - Validates only the blocks whose payload
+ * intersects [lo, hi), so a full verification can be spread over idle
+ * ticks by sweeping a window across the heap. The walk header-hops
+ * from the heap base to find the window, so callers should advance lo
+ * monotonically and keep windows coarse. Each block in the window
+ * gets the O(1) checks; nothing here searches a list
+ */
+void mm_checkheap_region(void *lo, void *hi)
+{
+    char *bp;
+
+    if (heap_listp == 0)
+        return;
+    for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0;
+         bp = NEXT_BLKP(bp)) {
+        if ((void *)bp >= hi)
+            break;
+        if ((void *)(bp + GET_SIZE(HDRP(bp))) <= lo)
+            continue;
+        checkblock_fast(bp);
+    }
 }
@@ -0,0 +1,312 @@
+/*
+ * mm_ext.h
+ *
+ * Public extensions to the allocator beyond the standard
+ * malloc/free/realloc/calloc surface declared in mm.h.
+ */
+#ifndef MM_EXT_H
+#define MM_EXT_H
+
+#include <stddef.h>
+
+/* Free-list insertion policies for mm_set_list_policy. MM_LIST_SIZE
+ * keeps each size class sorted ascending so searches return the
+ * smallest sufficient block (best fit); MM_LIST_LIFO is the cheaper
+ * push-to-front policy that maximizes temporal reuse; MM_LIST_ADDR
+ * keeps each class sorted by block address, which steers first fit
+ * toward low addresses so long-running heaps compact downward and the
+ * top stays trimmable; MM_LIST_NEXTFIT inserts like LIFO but resumes
+ * each search from a per-class rover where the previous one stopped
+ * (wrapping once), so steady-state churn stops rescanning the same
+ * unusable stretch at the head of the list. Building with NEXT_FIT
+ * defined makes MM_LIST_NEXTFIT the default policy. */
+#define MM_LIST_LIFO 0
+#define MM_LIST_SIZE 1
+#define MM_LIST_ADDR 2
+#define MM_LIST_NEXTFIT 3
+
+void mm_set_list_policy(int policy);
+
+/* Deferred coalescing: when enabled, free becomes a plain list push
+ * onto a quarantine and neighbor merging happens in batches - when
+ * the quarantine hits its size threshold, when a search comes up
+ * empty, or when the caller asks for it explicitly. Disabling the
+ * mode drains the quarantine. */
+void mm_set_defer_coalesce(int on);
+void mm_coalesce_all(void);
+
+/* Incremental maintenance. mm_maintain runs pending background work -
+ * merging deferred frees, flushing overfull thread-cache bins,
+ * trimming the heap top - in steps, rechecking the elapsed time
+ * against budget_ns between steps so a latency-sensitive event loop
+ * can pump it from idle ticks (0 removes the bound). Returns the
+ * number of steps taken; 0 means nothing was pending.
+ * mm_maintenance_start runs the same pump from a dedicated thread
+ * every interval_ms; it needs the MM_ARENAS locking and returns -1 in
+ * builds without it. */
+size_t mm_maintain(unsigned long budget_ns);
+int mm_maintenance_start(unsigned int interval_ms, unsigned long budget_ns);
+void mm_maintenance_stop(void);
+
+/* Per-subsystem allocation accounting. mm_malloc_tagged charges the
+ * block's capacity to a small tag id (1..MM_TAGMAX; 0 and anything
+ * out of range mean plain malloc) and free/realloc keep the charge
+ * accurate across the block's life, so RSS growth can be attributed
+ * without external profiler tooling. mm_tag_live reads one tag's live
+ * bytes (and block count); mm_tag_report dumps every charged tag to
+ * stdout. Untagged traffic pays nothing while no tagged block is
+ * live; the side table holds MM_TAGTAB blocks, beyond which extra
+ * tags are dropped (counted in the report). */
+#define MM_TAGMAX 255
+
+void *mm_malloc_tagged(size_t size, unsigned int tag);
+size_t mm_tag_live(unsigned int tag, size_t *blocks);
+void mm_tag_report(void);
+
+/* Opt-in compaction. Free blocks pinned between long-lived
+ * allocations never merge through coalescing alone; mm_compact walks
+ * the heap and slides allocated blocks down into the free gap below
+ * them, merging the vacated space upward, for at most max_moves
+ * relocations (returns how many happened). Before each move the
+ * registered callback is offered the block's current and prospective
+ * payload addresses; returning 0 consents, after which the allocator
+ * copies the payload and the application owns the block at newp.
+ * Return nonzero to pin a block - and always for pointers the
+ * application does not recognize as its own. Call from the same idle
+ * ticks as mm_maintain; on an MM_ARENAS heap quiesce other threads
+ * first, as for mm_snapshot. */
+typedef int (*mm_move_cb)(void *ctx, void *oldp, void *newp, size_t len);
+
+void mm_register_move_cb(mm_move_cb cb, void *ctx);
+size_t mm_compact(size_t max_moves);
+
+/* Init-time configuration. The heap extension size starts at
+ * chunk_min, doubles under sustained allocation pressure up to
+ * chunk_max, and decays back when coalescing shows the heap has gone
+ * quiescent. mm_init_cfg(NULL) is equivalent to mm_init(). */
+struct mm_config {
+    size_t chunk_min;    /* First/smallest heap extension, in bytes */
+    size_t chunk_max;    /* Largest extension the growth policy may reach */
+    int list_policy;     /* One of the MM_LIST_* policies */
+    int defer_coalesce;  /* Nonzero starts with deferred coalescing on */
+    size_t trim_threshold; /* Auto-trim when the top free block reaches
+                            * this size; 0 (the default) disables it */
+    size_t mmap_threshold; /* Requests at least this big get their own
+                            * anonymous mapping instead of the sbrk
+                            * heap (default 128 KB; 0 disables the
+                            * direct-map path). Mapped blocks never
+                            * enter the free lists and are invisible
+                            * to mm_checkheap/mm_snapshot */
+    int realloc_grow;      /* Percent of capacity slack a growing
+                            * realloc adds on top of the request, with
+                            * shrink hysteresis so the slack survives
+                            * until the request falls below half the
+                            * block. 0 (the default) disables both and
+                            * keeps exact-fit resizing */
+};
+
+void mm_default_config(struct mm_config *cfg);
+int mm_init_cfg(const struct mm_config *cfg);
+
+/* Releases free memory at the top of the heap back to the system,
+ * keeping at least pad bytes of it in reserve. Returns the number of
+ * bytes given back. free triggers this automatically once the top
+ * free block reaches cfg.trim_threshold. */
+size_t mm_trim(size_t pad);
+
+/* Size-specialized allocation. MM_SIZED_ASIZE mirrors the allocator's
+ * internal rounding (header word, 8-byte alignment, minimum block
+ * size - 24 bytes under MM_LARGEHEAP, 16 otherwise) so that when the
+ * request size is a compile-time constant the whole computation folds
+ * away. mm_malloc_prepared takes the rounded size directly and starts
+ * at the list lookup; call it only through mm_malloc_sized or with a
+ * size MM_SIZED_ASIZE produced. */
+#ifdef MM_LARGEHEAP
+#define MM_SIZED_MINBLK ((size_t)24)
+#else
+#define MM_SIZED_MINBLK ((size_t)16)
+#endif
+#define MM_SIZED_ASIZE(n) \
+    ((size_t)(n) + 4 <= MM_SIZED_MINBLK ? MM_SIZED_MINBLK \
+                                        : (((size_t)(n) + 4 + 7) & ~(size_t)7))
+
+void *mm_malloc_prepared(size_t asize);
+
+static inline void *mm_malloc_sized(size_t n)
+{
+    return mm_malloc_prepared(MM_SIZED_ASIZE(n));
+}
+
+/* Batch allocation: fills out[0..n) with blocks of the given size,
+ * carving them out of as few free blocks as possible so the list
+ * traversal and split cost is paid once per batch, not per block.
+ * Returns how many blocks were delivered (n unless the heap cannot
+ * grow). mm_free_batch releases n blocks in one address-ordered sweep
+ * that merges physically adjacent entries before touching the free
+ * lists; NULL entries are ignored. The ptrs array is reordered. */
+size_t mm_malloc_batch(size_t size, size_t n, void **out);
+void mm_free_batch(void **ptrs, size_t n);
+
+/* Epochs: request-scoped bulk free. mm_epoch_begin opens an epoch
+ * and returns its handle (-1 when all slots are taken);
+ * mm_epoch_malloc allocates into the innermost open epoch and
+ * mm_epoch_track attributes any live block to it.
+ * mm_epoch_release(h) frees everything the epoch collected through
+ * mm_free_batch's address-sorted single-pass sweep and returns the
+ * block count, removing per-object free calls from the request path.
+ * Epochs nest and are strictly thread-local: begin, fill and release
+ * on the same thread. Do not free or realloc a tracked block
+ * directly - the release would free the stale pointer again. */
+int mm_epoch_begin(void);
+void *mm_epoch_malloc(size_t size);
+int mm_epoch_track(void *ptr);
+size_t mm_epoch_release(int h);
+
+/* Bytes the block at ptr can hold: the requested size rounded up by
+ * placement, plus any realloc_grow slack. Appending up to this
+ * capacity needs no realloc call; realloc within it returns the same
+ * pointer. 0 for NULL. */
+size_t mm_usable_size(void *ptr);
+
+/* NUMA placement. Builds with MM_NUMA (on top of MM_ARENAS) bind
+ * each arena to the node of the first thread that claims it, steer
+ * threads to an arena on their own node, and mbind every region the
+ * arena grows - so allocation is node-local by construction.
+ * mm_block_node reports the node holding the block's first page;
+ * mm_pin_node migrates the pages a block spans to a chosen node (at
+ * page granularity - neighbors sharing an edge page move too), which
+ * lets pipeline stages place shared buffers deliberately. Both work
+ * in any build on Linux and return -1 where the kernel has no NUMA
+ * support. */
+int mm_block_node(void *ptr);
+int mm_pin_node(void *ptr, int node);
+
+/* Sampling profiler. mm_set_sample_rate(n) records every n-th
+ * malloc/free (0 disables) into a fixed internal ring: block size,
+ * cycles spent acquiring memory (rdtsc; 0 on other architectures),
+ * and how the request was satisfied. mm_prof_read drains the ring
+ * oldest-first. The mm_stats counters are maintained on the slow path
+ * regardless of the sampling rate; under MM_ARENAS they are updated
+ * without locks and should be read as estimates. */
+#define MM_PROF_MALLOC 0
+#define MM_PROF_FREE   1
+
+#define MM_FIT_LIST    0  /* Served from / returned to the free lists */
+#define MM_FIT_EXTEND  1  /* Needed extend_heap */
+#define MM_FIT_TCACHE  2  /* Thread cache hit */
+#define MM_FIT_FAIL    3  /* Heap could not grow */
+
+struct mm_sample {
+    size_t size;           /* Adjusted block size */
+    unsigned long cycles;  /* Latency of the sampled call */
+    unsigned char op;      /* MM_PROF_MALLOC or MM_PROF_FREE */
+    unsigned char outcome; /* MM_FIT_* */
+};
+
+struct mm_stats {
+    size_t heap_bytes;     /* Current heap size */
+    size_t peak_heap;      /* Largest the heap has been */
+    size_t live_bytes;     /* Bytes in blocks marked allocated (this
+                            * includes thread-cached, quarantined and
+                            * bitmap-run blocks the allocator is still
+                            * holding) */
+    size_t peak_live;      /* High-water mark of live_bytes */
+    size_t free_bytes;     /* Bytes on the free lists */
+    size_t free_blocks;    /* Free-list length across all classes */
+    size_t largest_free;   /* Biggest single free block; the external
+                            * fragmentation ratio is
+                            * 1 - largest_free/free_bytes */
+    unsigned long nmalloc; /* Calls, including batch and sized */
+    unsigned long nfree;
+    unsigned long nextend; /* extend_heap fallbacks */
+    unsigned long nsample; /* Samples taken since init */
+    size_t mapped_bytes;   /* Bytes in directly-mapped large blocks */
+    unsigned long nmmap;   /* Direct mappings made since init */
+};
+
+void mm_set_sample_rate(unsigned int rate);
+size_t mm_prof_read(struct mm_sample *out, size_t max);
+void mm_stats_snapshot(struct mm_stats *out);
+
+/* Binary heap snapshot for offline fragmentation analysis.
+ *
+ * Format: one mm_snap_hdr, then hdr.nrecords mm_snap_rec entries in
+ * heap address order, all in native byte order with the field widths
+ * below (no padding on LP64). Offsets are payload addresses relative
+ * to the heap base the allocator uses for its free-list links, so
+ * rec.pred/rec.succ can be matched against rec.off directly; 0 is the
+ * list terminator. Region fences (MM_ARENAS/MM_LARGEHEAP builds)
+ * appear as 8-byte allocated blocks. The walk takes no locks: on a
+ * multithreaded heap, quiesce first or treat the result as a torn
+ * estimate, same as mm_checkheap. */
+#define MM_SNAP_MAGIC   "MMH1"
+#define MM_SNAP_VERSION 1
+
+#define MM_SNAPF_LARGEHEAP 0x1
+#define MM_SNAPF_ARENAS    0x2
+
+struct mm_snap_hdr {
+    char magic[4];           /* MM_SNAP_MAGIC */
+    unsigned short version;  /* MM_SNAP_VERSION */
+    unsigned short flags;    /* MM_SNAPF_* build options */
+    size_t heap_bytes;       /* Total heap size at snapshot time */
+    size_t nrecords;         /* Block records that follow */
+};
+
+struct mm_snap_rec {
+    size_t off;              /* Payload offset from the heap base */
+    size_t size;             /* Block size including overhead */
+    size_t pred;             /* Free-list links (0 unless free) */
+    size_t succ;
+    unsigned int bits;       /* bit0 allocated, bit1 prev allocated */
+    unsigned int klass;      /* Size class index (free blocks only) */
+};
+
+/* The writer is called with consecutive chunks of the stream; return
+ * 0 to continue or nonzero to abort (mm_snapshot returns -1). The fd
+ * and buffer variants are conveniences over the same walk;
+ * mm_snapshot_buf fails (-1) if cap is too small and stores the
+ * bytes written through used either way. */
+typedef int (*mm_snap_writer)(void *ctx, const void *buf, size_t len);
+
+int mm_snapshot(mm_snap_writer writer, void *ctx);
+int mm_snapshot_fd(int fd);
+int mm_snapshot_buf(void *buf, size_t cap, size_t *used);
+
+/* Persistent heap mode. mm_attach backs the heap with a shared
+ * mapping of the file at path instead of the sbrk heap: a fresh or
+ * unrecognized file becomes a new persistent heap (returns 0), a
+ * valid image written by mm_detach is remapped with every block - and
+ * the free lists, which use base-relative offsets throughout - intact
+ * (returns 1, after an mm_checkheap validation walk). Images that
+ * were not detached cleanly or come from a build with different
+ * option flags are refused (-1). mm_detach flushes thread caches,
+ * spills the allocator roots into the image's header page, sets the
+ * clean-shutdown flag and unmaps; the next malloc starts over on a
+ * normal sbrk heap. The direct-map path is disabled while attached
+ * (mapped blocks live outside the image), and MM_ARENAS builds do not
+ * support persistence. */
+int mm_attach(const char *path);
+int mm_detach(void);
+
+/* The image remaps at a different address each run, so raw pointers
+ * into it do not survive reattach. The root is the one pointer the
+ * allocator translates across sessions: set it to a block whose
+ * contents reach everything else through relative offsets.
+ * mm_get_root returns NULL when no heap is attached or no root was
+ * set. */
+void mm_set_root(void *p);
+void *mm_get_root(void);
+
+/* Incremental validation. mm_checkheap_quick cross-checks the running
+ * counters (live + free + overhead bytes must equal the heap size)
+ * and the prologue/epilogue in O(1), cheap enough to call per
+ * request. mm_checkheap_region validates just the blocks intersecting
+ * [lo, hi) with constant work per block, so sweeping a window across
+ * the heap spreads full verification over idle ticks. Both follow
+ * mm_checkheap's convention: corruption prints a diagnostic and
+ * exits. */
+void mm_checkheap_quick(void);
+void mm_checkheap_region(void *lo, void *hi);
+
+#endif /* ndef MM_EXT_H */
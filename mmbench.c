@@ -0,0 +1,302 @@
+/*
+ * mmbench.c
+ *
+ * Benchmark harness for the allocator. Runs either a recorded trace
+ * (see mmtrace.h for the format and how to capture one) or one of the
+ * built-in synthetic workloads, and reports throughput, peak heap
+ * versus peak live bytes (utilization), and latency percentiles for
+ * the allocation path taken from the sampling profiler - the sampled
+ * cycle counts cover find_fit plus whatever placement or extension
+ * the request needed.
+ *
+ * Build:  gcc -O2 -DDRIVER -o mmbench mmbench.c mm.c memlib.c
+ *         (add the usual option flags - -DMM_TCACHE etc. - to bench
+ *         a particular configuration)
+ * Usage:  mmbench replay FILE
+ *         mmbench lifo|random|prodcons [nops]
+ *
+ * Replay is single-threaded: the recorder serializes records, so
+ * playing them back in order is a legal interleaving of the original
+ * run, though not a measurement of its contention.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm_ext.h"
+#include "mmtrace.h"
+
+#define DEFAULT_NOPS 1000000
+#define SAMPLE_RATE  64
+#define MAX_SAMPLES  (1 << 20)
+#define SLOTS        4096      /* random workload live-set bound */
+#define LIFO_DEPTH   64
+#define RING_DEPTH   1024      /* prodcons FIFO depth */
+
+static unsigned long *lat;     /* Sampled malloc-path cycle counts */
+static size_t nlat;
+
+/* Drains the profiler ring into the latency array, keeping only the
+ * allocation samples. Called often enough that the ring never wraps */
+static void drain_samples(void)
+{
+    struct mm_sample buf[64];
+    size_t n, i;
+
+    while ((n = mm_prof_read(buf, 64)) > 0)
+        for (i = 0; i < n; i++)
+            if (buf[i].op == MM_PROF_MALLOC && nlat < MAX_SAMPLES)
+                lat[nlat++] = buf[i].cycles;
+}
+
+static int cmp_ulong(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *)a;
+    unsigned long y = *(const unsigned long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, size_t nops, double secs)
+{
+    struct mm_stats st;
+
+    drain_samples();
+    mm_stats_snapshot(&st);
+
+    printf("%s: %zu ops in %.3f s (%.2f Mops/s)\n",
+           name, nops, secs, nops / secs / 1e6);
+    printf("heap: peak %zu B, peak live %zu B, utilization %.1f%%\n",
+           st.peak_heap, st.peak_live,
+           st.peak_heap ? 100.0 * st.peak_live / st.peak_heap : 0.0);
+    printf("free: %zu B in %zu blocks, largest %zu B\n",
+           st.free_bytes, st.free_blocks, st.largest_free);
+    if (nlat > 0) {
+        qsort(lat, nlat, sizeof(lat[0]), cmp_ulong);
+        printf("alloc latency (%zu samples): p50=%lu p90=%lu p99=%lu cycles\n",
+               nlat, lat[nlat/2], lat[nlat*9/10], lat[nlat*99/100]);
+    }
+}
+
+/*
+ * run_replay - Plays a recorded trace back against the allocator,
+ * mapping the trace's dense object ids onto live pointers. Records
+ * with id 0 were unknown to the recorder and are skipped
+ */
+static int run_replay(const char *path)
+{
+    struct mm_trace_hdr hdr;
+    struct mm_trace_rec rec;
+    struct timespec t0, t1;
+    void **tab;
+    size_t tabsize = 1 << 16, nops = 0;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "mmbench: cannot open %s\n", path);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, MM_TRACE_MAGIC, 4) != 0 ||
+        hdr.version != MM_TRACE_VERSION) {
+        fprintf(stderr, "mmbench: %s is not a version %d trace\n",
+                path, MM_TRACE_VERSION);
+        fclose(f);
+        return 1;
+    }
+
+    tab = calloc(tabsize, sizeof(void *));
+    if (tab == NULL)
+        return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        void *p;
+
+        if (rec.id >= tabsize || rec.old_id >= tabsize) {
+            size_t newsize = tabsize;
+            void **newtab;
+
+            while (rec.id >= newsize || rec.old_id >= newsize)
+                newsize *= 2;
+            newtab = calloc(newsize, sizeof(void *));
+            if (newtab == NULL)
+                return 1;
+            memcpy(newtab, tab, tabsize * sizeof(void *));
+            free(tab);
+            tab = newtab;
+            tabsize = newsize;
+        }
+        switch (rec.op) {
+        case MM_TR_MALLOC:
+            if (rec.id)
+                tab[rec.id] = mm_malloc(rec.size);
+            break;
+        case MM_TR_CALLOC:
+            if (rec.id)
+                tab[rec.id] = mm_calloc(rec.size, 1);
+            break;
+        case MM_TR_REALLOC:
+            p = rec.old_id ? tab[rec.old_id] : NULL;
+            if (rec.old_id)
+                tab[rec.old_id] = NULL;
+            p = mm_realloc(p, rec.size);
+            if (rec.id)
+                tab[rec.id] = p;
+            break;
+        case MM_TR_FREE:
+            if (rec.id) {
+                mm_free(tab[rec.id]);
+                tab[rec.id] = NULL;
+            }
+            break;
+        default:
+            fprintf(stderr, "mmbench: bad op %d at record %zu\n",
+                    rec.op, nops);
+            fclose(f);
+            return 1;
+        }
+        nops++;
+        if ((nops & 0xfff) == 0)
+            drain_samples();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fclose(f);
+    free(tab);
+
+    report("replay", nops,
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    return 0;
+}
+
+/*
+ * run_lifo - LIFO churn: fill a small stack of blocks, pop it empty,
+ * repeat. Exercises the temporal-reuse fast paths (thread cache and
+ * list heads) with near-zero fragmentation pressure
+ */
+static void run_lifo(size_t nops)
+{
+    void *stack[LIFO_DEPTH];
+    size_t top = 0, i;
+
+    for (i = 0; i < nops; i++) {
+        if (top < LIFO_DEPTH)
+            stack[top++] = mm_malloc(128);
+        else
+            while (top > 0)
+                mm_free(stack[--top]);
+        if ((i & 0xfff) == 0)
+            drain_samples();
+    }
+    while (top > 0)
+        mm_free(stack[--top]);
+}
+
+/*
+ * run_random - Random sizes against a bounded live set: each op picks
+ * a slot and frees it if occupied, else fills it with a block of
+ * 16..2048 bytes. Exercises the size classes and coalescing
+ */
+static void run_random(size_t nops)
+{
+    static void *slot[SLOTS];
+    size_t i;
+
+    srand(42);    /* Fixed seed: runs must be comparable */
+    for (i = 0; i < nops; i++) {
+        size_t k = rand() % SLOTS;
+
+        if (slot[k] != NULL) {
+            mm_free(slot[k]);
+            slot[k] = NULL;
+        }
+        else
+            slot[k] = mm_malloc((rand() % 2033) + 16);
+        if ((i & 0xfff) == 0)
+            drain_samples();
+    }
+    for (i = 0; i < SLOTS; i++)
+        if (slot[i] != NULL)
+            mm_free(slot[i]);
+}
+
+/*
+ * run_prodcons - Producer-consumer pattern: blocks are allocated at
+ * the head of a FIFO ring and freed from the tail once the ring is
+ * full, so every block dies exactly RING_DEPTH allocations after its
+ * birth. The steady FIFO order defeats LIFO reuse and shows how the
+ * allocator behaves when frees arrive "cold"
+ */
+static void run_prodcons(size_t nops)
+{
+    static void *ring[RING_DEPTH];
+    size_t head = 0, i;
+
+    for (i = 0; i < nops; i++) {
+        if (ring[head] != NULL)
+            mm_free(ring[head]);
+        ring[head] = mm_malloc(64 + (i % 7) * 32);
+        head = (head + 1) % RING_DEPTH;
+        if ((i & 0xfff) == 0)
+            drain_samples();
+    }
+    for (i = 0; i < RING_DEPTH; i++)
+        if (ring[i] != NULL)
+            mm_free(ring[i]);
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec t0, t1;
+    size_t nops = DEFAULT_NOPS;
+    void (*work)(size_t) = NULL;
+
+    if (argc < 2) {
+        fprintf(stderr,
+                "usage: %s replay FILE | lifo|random|prodcons [nops]\n",
+                argv[0]);
+        return 1;
+    }
+
+    mem_init();
+    if (mm_init() != 0) {
+        fprintf(stderr, "mmbench: mm_init failed\n");
+        return 1;
+    }
+    lat = malloc(MAX_SAMPLES * sizeof(lat[0]));
+    if (lat == NULL)
+        return 1;
+    mm_set_sample_rate(SAMPLE_RATE);
+
+    if (strcmp(argv[1], "replay") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "usage: %s replay FILE\n", argv[0]);
+            return 1;
+        }
+        return run_replay(argv[2]);
+    }
+
+    if (strcmp(argv[1], "lifo") == 0)
+        work = run_lifo;
+    else if (strcmp(argv[1], "random") == 0)
+        work = run_random;
+    else if (strcmp(argv[1], "prodcons") == 0)
+        work = run_prodcons;
+    else {
+        fprintf(stderr, "mmbench: unknown workload %s\n", argv[1]);
+        return 1;
+    }
+    if (argc > 2)
+        nops = strtoul(argv[2], NULL, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    work(nops);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    report(argv[1], nops,
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * mmtrace.c
+ *
+ * Trace recorder behind the MM_TRACE hooks in mm.c. Pointers are
+ * translated to dense ids through a fixed open-addressing hash table
+ * so the trace is position independent; a mutex serializes recording,
+ * which also gives replay a single legal interleaving. If the live
+ * set outgrows the table, recording stops and the trace stays valid
+ * up to that point.
+ *
+ * Link with -pthread when tracing threaded programs.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mmtrace.h"
+
+#define TR_TABSIZE (1 << 16)   /* Max live objects while recording */
+
+static FILE *tr_file;
+static pthread_mutex_t tr_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int tr_next_id;
+static unsigned int tr_nlive;
+static int tr_ntids;
+static __thread int tr_tid = -1;
+
+static struct {
+    void *ptr;                 /* NULL = empty, (void *)-1 = deleted */
+    unsigned int id;
+} tr_tab[TR_TABSIZE];
+
+static unsigned int tr_hash(void *p)
+{
+    unsigned long h = (unsigned long)p;
+
+    h ^= h >> 17;
+    h *= 0x9e3779b97f4a7c15UL;
+    return (unsigned int)(h >> 40) & (TR_TABSIZE - 1);
+}
+
+/* Inserts p and returns its fresh id, or 0 when the table is full */
+static unsigned int tr_insert(void *p)
+{
+    unsigned int i = tr_hash(p);
+
+    if (tr_nlive >= TR_TABSIZE - 1)
+        return 0;
+    while (tr_tab[i].ptr != NULL && tr_tab[i].ptr != (void *)-1)
+        i = (i + 1) & (TR_TABSIZE - 1);
+    tr_tab[i].ptr = p;
+    tr_tab[i].id = ++tr_next_id;
+    tr_nlive++;
+    return tr_tab[i].id;
+}
+
+/* Removes p and returns the id it had, or 0 if it was never seen */
+static unsigned int tr_remove(void *p)
+{
+    unsigned int i = tr_hash(p);
+
+    while (tr_tab[i].ptr != NULL) {
+        if (tr_tab[i].ptr == p) {
+            unsigned int id = tr_tab[i].id;
+
+            tr_tab[i].ptr = (void *)-1;
+            tr_nlive--;
+            return id;
+        }
+        i = (i + 1) & (TR_TABSIZE - 1);
+    }
+    return 0;
+}
+
+int mm_trace_start(const char *path)
+{
+    struct mm_trace_hdr hdr;
+    int rc = 0;
+
+    pthread_mutex_lock(&tr_lock);
+    if (tr_file == NULL) {
+        tr_file = fopen(path, "wb");
+        if (tr_file == NULL)
+            rc = -1;
+        else {
+            memset(tr_tab, 0, sizeof(tr_tab));
+            tr_next_id = 0;
+            tr_nlive = 0;
+            tr_ntids = 0;
+            memcpy(hdr.magic, MM_TRACE_MAGIC, 4);
+            hdr.version = MM_TRACE_VERSION;
+            hdr.pad = 0;
+            fwrite(&hdr, sizeof(hdr), 1, tr_file);
+        }
+    }
+    pthread_mutex_unlock(&tr_lock);
+    return rc;
+}
+
+void mm_trace_stop(void)
+{
+    pthread_mutex_lock(&tr_lock);
+    if (tr_file != NULL) {
+        fclose(tr_file);
+        tr_file = NULL;
+    }
+    pthread_mutex_unlock(&tr_lock);
+}
+
+void mm_trace_event(int op, size_t size, void *old, void *result)
+{
+    struct mm_trace_rec rec;
+
+    pthread_mutex_lock(&tr_lock);
+    if (tr_file == NULL) {
+        pthread_mutex_unlock(&tr_lock);
+        return;
+    }
+    if (tr_tid < 0)
+        tr_tid = tr_ntids++;
+
+    rec.op = (unsigned char)op;
+    rec.tid = (unsigned char)tr_tid;
+    rec.pad = 0;
+    rec.size = size;
+    rec.old_id = 0;
+    rec.pad2 = 0;
+    switch (op) {
+    case MM_TR_FREE:
+        rec.id = tr_remove(old);
+        break;
+    case MM_TR_REALLOC:
+        rec.old_id = tr_remove(old);
+        rec.id = result != NULL ? tr_insert(result) : 0;
+        break;
+    default:
+        rec.id = result != NULL ? tr_insert(result) : 0;
+        break;
+    }
+    fwrite(&rec, sizeof(rec), 1, tr_file);
+    pthread_mutex_unlock(&tr_lock);
+}
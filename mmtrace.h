@@ -0,0 +1,58 @@
+/*
+ * mmtrace.h
+ *
+ * Allocation trace format and recorder API.
+ *
+ * A trace is one mm_trace_hdr followed by mm_trace_rec entries in the
+ * order the operations completed, native byte order. Pointers are
+ * never stored; each live object gets a small dense id when it is
+ * created and the id is retired when the object is freed, so a trace
+ * replays identically in any address space. id 0 means the pointer
+ * was unknown to the recorder (allocated before recording started, or
+ * the call failed) - replay skips those.
+ *
+ * Recording is enabled by building mm.c with -DMM_TRACE and linking
+ * mmtrace.c, then calling mm_trace_start. The hooks sit in the public
+ * malloc/free/realloc/calloc entry points (the same surface the
+ * DRIVER aliases expose), so internal allocations - a realloc's
+ * fallback malloc, for example - are not double-recorded. The batch
+ * and sized entry points are not traced.
+ */
+#ifndef MMTRACE_H
+#define MMTRACE_H
+
+#include <stddef.h>
+
+#define MM_TRACE_MAGIC   "MMTR"
+#define MM_TRACE_VERSION 1
+
+#define MM_TR_MALLOC  0   /* Creates id           */
+#define MM_TR_CALLOC  1   /* Creates id           */
+#define MM_TR_REALLOC 2   /* old_id becomes id    */
+#define MM_TR_FREE    3   /* Retires id           */
+
+struct mm_trace_hdr {
+    char magic[4];          /* MM_TRACE_MAGIC */
+    unsigned short version; /* MM_TRACE_VERSION */
+    unsigned short pad;
+};
+
+struct mm_trace_rec {
+    unsigned char op;       /* MM_TR_* */
+    unsigned char tid;      /* Dense per-thread index, 0-based */
+    unsigned short pad;
+    unsigned int id;        /* Object this op creates or retires */
+    size_t size;            /* Request bytes (calloc: nmemb*size) */
+    unsigned int old_id;    /* MM_TR_REALLOC: object being resized */
+    unsigned int pad2;
+};
+
+/* Starts appending records to path; returns 0 or -1. Stop flushes
+ * and closes. Both are idempotent. */
+int mm_trace_start(const char *path);
+void mm_trace_stop(void);
+
+/* Called by the MM_TRACE hooks in mm.c; not for direct use. */
+void mm_trace_event(int op, size_t size, void *old, void *result);
+
+#endif /* ndef MMTRACE_H */